@@ -0,0 +1,20 @@
+include(../nymea-networkmanager.pri)
+
+# Stub D-Bus services for the startup benchmark, not installed
+TARGET = nymea-networkmanager-stubs
+
+QT += core dbus
+QT -= gui
+
+CONFIG += console
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+HEADERS += \
+    stubobject.h \
+
+SOURCES += \
+    main.cpp \
+    stubobject.cpp \
+
@@ -0,0 +1,264 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QCommandLineOption>
+#include <QDBusConnection>
+#include <QDBusObjectPath>
+#include <QDBusMetaType>
+#include <QDebug>
+
+#include "stubobject.h"
+
+// Stub NetworkManager, nymead and BlueZ services for benchmarking nymea-networkmanager on a private bus.
+// The bus is the one nymea-networkmanager uses as system bus, set DBUS_SYSTEM_BUS_ADDRESS for both.
+
+typedef QMap<QString, QVariantMap> InterfaceList;
+typedef QMap<QDBusObjectPath, InterfaceList> ManagedObjectList;
+Q_DECLARE_METATYPE(InterfaceList)
+Q_DECLARE_METATYPE(ManagedObjectList)
+
+static const QString s_networkManagerService = "org.freedesktop.NetworkManager";
+static const QString s_networkManagerPath = "/org/freedesktop/NetworkManager";
+static const QString s_settingsPath = "/org/freedesktop/NetworkManager/Settings";
+static const QString s_devicePath = "/org/freedesktop/NetworkManager/Devices/1";
+static const QString s_nymeadService = "io.guh.nymead";
+static const QString s_nymeadBluetoothPath = "/io/guh/nymead/HardwareManager/BluetoothLEManager";
+static const QString s_bluezService = "org.bluez";
+static const QString s_bluezAdapterPath = "/org/bluez/hci0";
+
+static bool registerObject(const QDBusConnection &connection, StubObject *object)
+{
+    QDBusConnection bus(connection);
+    if (!bus.registerVirtualObject(object->path(), object, QDBusConnection::SingleNode)) {
+        qWarning() << "Could not register" << object->path() << bus.lastError().message();
+        return false;
+    }
+
+    return true;
+}
+
+static bool registerNetworkManager(const QDBusConnection &connection, int latency, uint state, bool wireless, QObject *parent)
+{
+    QList<QDBusObjectPath> devices;
+    if (wireless)
+        devices.append(QDBusObjectPath(s_devicePath));
+
+    const QString networkManagerInterface = "org.freedesktop.NetworkManager";
+    StubObject *networkManager = new StubObject(s_networkManagerPath, latency, parent);
+    networkManager->addProperty(networkManagerInterface, "Version", "s", QString("1.22.10"));
+    networkManager->addProperty(networkManagerInterface, "State", "u", state);
+    networkManager->addProperty(networkManagerInterface, "Connectivity", "u", state >= 70 ? 4u : 1u);
+    networkManager->addProperty(networkManagerInterface, "NetworkingEnabled", "b", true);
+    networkManager->addProperty(networkManagerInterface, "WirelessEnabled", "b", true);
+    networkManager->addProperty(networkManagerInterface, "WirelessHardwareEnabled", "b", true);
+    networkManager->addProperty(networkManagerInterface, "Devices", "ao", QVariant::fromValue(devices));
+    networkManager->addProperty(networkManagerInterface, "AllDevices", "ao", QVariant::fromValue(devices));
+    networkManager->addProperty(networkManagerInterface, "ActiveConnections", "ao", QVariant::fromValue(QList<QDBusObjectPath>()));
+    networkManager->addProperty(networkManagerInterface, "PrimaryConnection", "o", QVariant::fromValue(QDBusObjectPath("/")));
+    networkManager->addMethod(networkManagerInterface, "GetDevices", "ao", { QVariant::fromValue(devices) });
+    networkManager->addMethod(networkManagerInterface, "GetAllDevices", "ao", { QVariant::fromValue(devices) });
+    networkManager->addMethod(networkManagerInterface, "state", "u", { state });
+    networkManager->addMethod(networkManagerInterface, "Enable");
+
+    const QString settingsInterface = "org.freedesktop.NetworkManager.Settings";
+    StubObject *settings = new StubObject(s_settingsPath, latency, parent);
+    settings->addProperty(settingsInterface, "Connections", "ao", QVariant::fromValue(QList<QDBusObjectPath>()));
+    settings->addProperty(settingsInterface, "Hostname", "s", QString("nymea"));
+    settings->addProperty(settingsInterface, "CanModify", "b", true);
+    settings->addMethod(settingsInterface, "ListConnections", "ao", { QVariant::fromValue(QList<QDBusObjectPath>()) });
+
+    // A disconnected wireless device without any access points
+    const QString deviceInterface = "org.freedesktop.NetworkManager.Device";
+    const QString wirelessInterface = "org.freedesktop.NetworkManager.Device.Wireless";
+    StubObject *device = new StubObject(s_devicePath, latency, parent);
+    device->addProperty(deviceInterface, "Udi", "s", QString("/sys/devices/virtual/net/wlan0"));
+    device->addProperty(deviceInterface, "Interface", "s", QString("wlan0"));
+    device->addProperty(deviceInterface, "IpInterface", "s", QString());
+    device->addProperty(deviceInterface, "Driver", "s", QString("stub"));
+    device->addProperty(deviceInterface, "DriverVersion", "s", QString());
+    device->addProperty(deviceInterface, "FirmwareVersion", "s", QString());
+    device->addProperty(deviceInterface, "State", "u", 30u);
+    device->addProperty(deviceInterface, "DeviceType", "u", 2u);
+    device->addProperty(deviceInterface, "Managed", "b", true);
+    device->addProperty(deviceInterface, "Autoconnect", "b", true);
+    device->addProperty(deviceInterface, "ActiveConnection", "o", QVariant::fromValue(QDBusObjectPath("/")));
+    device->addProperty(deviceInterface, "Ip4Config", "o", QVariant::fromValue(QDBusObjectPath("/")));
+    device->addProperty(deviceInterface, "AvailableConnections", "ao", QVariant::fromValue(QList<QDBusObjectPath>()));
+    device->addMethod(deviceInterface, "Disconnect");
+    device->addProperty(wirelessInterface, "HwAddress", "s", QString("02:00:00:00:00:01"));
+    device->addProperty(wirelessInterface, "PermHwAddress", "s", QString("02:00:00:00:00:01"));
+    device->addProperty(wirelessInterface, "Mode", "u", 2u);
+    device->addProperty(wirelessInterface, "Bitrate", "u", 0u);
+    device->addProperty(wirelessInterface, "AccessPoints", "ao", QVariant::fromValue(QList<QDBusObjectPath>()));
+    device->addProperty(wirelessInterface, "ActiveAccessPoint", "o", QVariant::fromValue(QDBusObjectPath("/")));
+    device->addMethod(wirelessInterface, "GetAccessPoints", "ao", { QVariant::fromValue(QList<QDBusObjectPath>()) });
+    device->addMethod(wirelessInterface, "GetAllAccessPoints", "ao", { QVariant::fromValue(QList<QDBusObjectPath>()) });
+    device->addMethod(wirelessInterface, "RequestScan");
+
+    if (!registerObject(connection, networkManager) || !registerObject(connection, settings) || !registerObject(connection, device))
+        return false;
+
+    QDBusConnection bus(connection);
+    return bus.registerService(s_networkManagerService);
+}
+
+static bool registerNymead(const QDBusConnection &connection, int latency, QObject *parent)
+{
+    StubObject *bluetooth = new StubObject(s_nymeadBluetoothPath, latency, parent);
+    bluetooth->addMethod("io.guh.nymead", "EnableBluetooth");
+    if (!registerObject(connection, bluetooth))
+        return false;
+
+    QDBusConnection bus(connection);
+    return bus.registerService(s_nymeadService);
+}
+
+static bool registerBluez(const QDBusConnection &connection, int latency, const QString &address, QObject *parent)
+{
+    // A powered LE adapter which accepts every advertisement and GATT application
+    const QString adapterInterface = "org.bluez.Adapter1";
+    const QString advertisingInterface = "org.bluez.LEAdvertisingManager1";
+    const QString gattInterface = "org.bluez.GattManager1";
+    StubObject *adapter = new StubObject(s_bluezAdapterPath, latency, parent);
+    adapter->addProperty(adapterInterface, "Address", "s", address);
+    adapter->addProperty(adapterInterface, "AddressType", "s", QString("public"));
+    adapter->addProperty(adapterInterface, "Name", "s", QString("stub"));
+    adapter->addProperty(adapterInterface, "Alias", "s", QString("stub"), true);
+    adapter->addProperty(adapterInterface, "Class", "u", 0u);
+    adapter->addProperty(adapterInterface, "Powered", "b", true, true);
+    adapter->addProperty(adapterInterface, "Discoverable", "b", false, true);
+    adapter->addProperty(adapterInterface, "DiscoverableTimeout", "u", 180u, true);
+    adapter->addProperty(adapterInterface, "Pairable", "b", false, true);
+    adapter->addProperty(adapterInterface, "PairableTimeout", "u", 0u, true);
+    adapter->addProperty(adapterInterface, "Discovering", "b", false);
+    adapter->addProperty(adapterInterface, "UUIDs", "as", QStringList());
+    adapter->addProperty(adapterInterface, "Modalias", "s", QString("usb:v1D6Bp0246d0537"));
+    adapter->addMethod(adapterInterface, "StartDiscovery");
+    adapter->addMethod(adapterInterface, "StopDiscovery");
+    adapter->addMethod(adapterInterface, "SetDiscoveryFilter");
+    adapter->addMethod(adapterInterface, "RemoveDevice");
+    adapter->addProperty(advertisingInterface, "ActiveInstances", "y", QVariant::fromValue<uchar>(0));
+    adapter->addProperty(advertisingInterface, "SupportedInstances", "y", QVariant::fromValue<uchar>(5));
+    adapter->addProperty(advertisingInterface, "SupportedIncludes", "as", QStringList() << "tx-power" << "appearance" << "local-name");
+    adapter->addMethod(advertisingInterface, "RegisterAdvertisement");
+    adapter->addMethod(advertisingInterface, "UnregisterAdvertisement");
+    adapter->addMethod(gattInterface, "RegisterApplication");
+    adapter->addMethod(gattInterface, "UnregisterApplication");
+
+    // The adapter gets enumerated through the object manager on the root object
+    InterfaceList adapterInterfaces;
+    foreach (const QString &interface, QStringList() << adapterInterface << advertisingInterface << gattInterface)
+        adapterInterfaces.insert(interface, adapter->properties(interface));
+
+    ManagedObjectList managedObjects;
+    managedObjects.insert(QDBusObjectPath(s_bluezAdapterPath), adapterInterfaces);
+
+    StubObject *root = new StubObject("/", latency, parent);
+    root->addMethod("org.freedesktop.DBus.ObjectManager", "GetManagedObjects", "a{oa{sa{sv}}}", { QVariant::fromValue(managedObjects) });
+
+    if (!registerObject(connection, adapter) || !registerObject(connection, root))
+        return false;
+
+    QDBusConnection bus(connection);
+    return bus.registerService(s_bluezService);
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication application(argc, argv);
+    application.setApplicationName("nymea-networkmanager-stubs");
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    parser.setApplicationDescription("Stub NetworkManager, nymead and BlueZ D-Bus services for benchmarking nymea-networkmanager. "
+                                     "The services are registered on the bus given in DBUS_SYSTEM_BUS_ADDRESS.");
+
+    QCommandLineOption latencyOption(QStringList() << "l" << "latency", "The reply latency of the NetworkManager stub in ms. Default 0.", "ms", "0");
+    parser.addOption(latencyOption);
+
+    QCommandLineOption nymeadLatencyOption("nymead-latency", "The reply latency of the nymead stub in ms. Default 0.", "ms", "0");
+    parser.addOption(nymeadLatencyOption);
+
+    QCommandLineOption bluezLatencyOption("bluez-latency", "The reply latency of the BlueZ stub in ms. Default 0.", "ms", "0");
+    parser.addOption(bluezLatencyOption);
+
+    QCommandLineOption adapterAddressOption("adapter-address", "The address of the BlueZ stub adapter, should match the controller used for advertising. Default 00:AA:01:00:00:23.", "address", "00:AA:01:00:00:23");
+    parser.addOption(adapterAddressOption);
+
+    QCommandLineOption stateOption("nm-state", "The NetworkManager state, 20 is disconnected and 70 connected globally. Default 20.", "state", "20");
+    parser.addOption(stateOption);
+
+    QCommandLineOption noWirelessOption("no-wireless", "Do not provide a wireless device.");
+    parser.addOption(noWirelessOption);
+
+    QCommandLineOption noNymeadOption("no-nymead", "Do not provide the nymead service.");
+    parser.addOption(noNymeadOption);
+
+    QCommandLineOption noBluezOption("no-bluez", "Do not provide the BlueZ service, e.g. if bluetoothd runs on the bus.");
+    parser.addOption(noBluezOption);
+
+    parser.process(application);
+
+    bool latencyValid = false;
+    bool nymeadLatencyValid = false;
+    bool bluezLatencyValid = false;
+    bool stateValid = false;
+    int latency = parser.value(latencyOption).toInt(&latencyValid);
+    int nymeadLatency = parser.value(nymeadLatencyOption).toInt(&nymeadLatencyValid);
+    int bluezLatency = parser.value(bluezLatencyOption).toInt(&bluezLatencyValid);
+    uint state = parser.value(stateOption).toUInt(&stateValid);
+    if (!latencyValid || !nymeadLatencyValid || !bluezLatencyValid || latency < 0 || nymeadLatency < 0 || bluezLatency < 0 || !stateValid) {
+        qWarning() << "Invalid latency or state given.";
+        return 1;
+    }
+
+    qDBusRegisterMetaType<InterfaceList>();
+    qDBusRegisterMetaType<ManagedObjectList>();
+
+    QDBusConnection connection = QDBusConnection::systemBus();
+    if (!connection.isConnected()) {
+        qWarning() << "Could not connect to the bus" << connection.lastError().message();
+        return 1;
+    }
+
+    if (!registerNetworkManager(connection, latency, state, !parser.isSet(noWirelessOption), &application)) {
+        qWarning() << "Could not register the NetworkManager stub" << connection.lastError().message();
+        return 1;
+    }
+
+    if (!parser.isSet(noNymeadOption) && !registerNymead(connection, nymeadLatency, &application)) {
+        qWarning() << "Could not register the nymead stub" << connection.lastError().message();
+        return 1;
+    }
+
+    if (!parser.isSet(noBluezOption) && !registerBluez(connection, bluezLatency, parser.value(adapterAddressOption), &application)) {
+        qWarning() << "Could not register the BlueZ stub" << connection.lastError().message();
+        return 1;
+    }
+
+    qDebug() << "Stub services running with a latency of" << latency << "ms for NetworkManager," << nymeadLatency << "ms for nymead and" << bluezLatency << "ms for BlueZ";
+    return application.exec();
+}
@@ -0,0 +1,77 @@
+#!/bin/sh
+
+# Runs the startup benchmark of nymea-networkmanager against the stub services on a private bus
+# and prints one JSON line per mode, the logs go to stubs.log and benchmark.log. Run it from the
+# build directory, the arguments are passed to the stubs, e.g. --latency 200
+#
+# The stubs provide NetworkManager, nymead and the BlueZ adapter interfaces. Qt Bluetooth sends the
+# advertising data to the controller through the kernel, so a controller has to exist as well. If
+# none is given in ADAPTER and btvirt is available, the script creates a virtual one (requires root).
+# The daemon runs with its own configuration file and state directory in a temporary directory.
+
+BUILDDIR=${BUILDDIR:-.}
+DAEMON=${DAEMON:-$BUILDDIR/nymea-networkmanager/nymea-networkmanager}
+STUBS=${STUBS:-$BUILDDIR/benchmarks/nymea-networkmanager-stubs}
+MODES=${MODES:-"offline once start always"}
+ADAPTER=${ADAPTER:-}
+
+WORKDIR=$(mktemp -d)
+BTVIRT_PID=
+
+cleanup() {
+    kill $STUBS_PID $BUS_PID $BTVIRT_PID 2> /dev/null
+    rm -rf "$WORKDIR"
+}
+trap cleanup EXIT
+
+if [ -z "$ADAPTER" ] && command -v btvirt > /dev/null && [ "$(id -u)" = "0" ]; then
+    btvirt -l1 > btvirt.log 2>&1 &
+    BTVIRT_PID=$!
+    sleep 1
+fi
+
+# Pass the address of the controller to the adapter stub, Qt Bluetooth selects the controller by it
+ADAPTER=${ADAPTER:-$(ls /sys/class/bluetooth 2> /dev/null | grep '^hci' | tail -n 1)}
+if [ -n "$ADAPTER" ] && command -v btmgmt > /dev/null; then
+    ADDRESS=$(btmgmt --index "$ADAPTER" info 2> /dev/null | sed -n 's/.*addr \([0-9A-F:]\{17\}\).*/\1/p' | head -n 1)
+fi
+
+if [ -z "$ADDRESS" ]; then
+    echo "No bluetooth controller found. The bluetooth server will not be able to advertise." >&2
+else
+    set -- --adapter-address "$ADDRESS" "$@"
+fi
+
+# The daemon finds the configuration in XDG_CONFIG_HOME before /etc
+mkdir -p "$WORKDIR/config/nymea" "$WORKDIR/state"
+cat > "$WORKDIR/config/nymea/nymea-networkmanager.conf" << EOF
+[General]
+Timeout=60
+AdvertiseName=bench
+PlatformName=benchmark
+DBusBusType=none
+StateDirectory=$WORKDIR/state
+EOF
+
+BUS_ADDRESS=$(dbus-daemon --session --print-address --print-pid --fork | {
+    read -r address
+    read -r pid
+    echo "$pid" > bus.pid
+    echo "$address"
+})
+BUS_PID=$(cat bus.pid)
+rm -f bus.pid
+
+export DBUS_SYSTEM_BUS_ADDRESS="$BUS_ADDRESS"
+
+"$STUBS" "$@" 2> stubs.log &
+STUBS_PID=$!
+
+# Wait until the stubs own their names
+sleep 1
+
+for mode in $MODES; do
+    # Every mode starts without a network snapshot from the previous run
+    rm -rf "$WORKDIR/state/"*
+    XDG_CONFIG_HOME="$WORKDIR/config" "$DAEMON" --benchmark -m "$mode" 2>> benchmark.log
+done
@@ -0,0 +1,154 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include "stubobject.h"
+
+#include <QTimer>
+#include <QDBusVariant>
+
+StubObject::StubObject(const QString &path, int latency, QObject *parent) :
+    QDBusVirtualObject(parent),
+    m_path(path),
+    m_latency(latency)
+{
+
+}
+
+QString StubObject::path() const
+{
+    return m_path;
+}
+
+void StubObject::addProperty(const QString &interface, const QString &name, const QString &signature, const QVariant &value, bool writable)
+{
+    m_properties[interface].insert(name, { signature, value, writable });
+}
+
+QVariantMap StubObject::properties(const QString &interface) const
+{
+    QVariantMap properties;
+    foreach (const QString &name, m_properties.value(interface).keys())
+        properties.insert(name, m_properties.value(interface).value(name).value);
+
+    return properties;
+}
+
+void StubObject::addMethod(const QString &interface, const QString &name, const QString &outSignature, const QVariantList &reply)
+{
+    m_methods[interface].insert(name, { outSignature, reply });
+}
+
+QString StubObject::introspect(const QString &path) const
+{
+    Q_UNUSED(path)
+
+    // The outer node and the standard interfaces are added by QtDBus
+    QStringList interfaces = m_properties.keys() + m_methods.keys();
+    interfaces.removeDuplicates();
+
+    QString xml;
+    foreach (const QString &interface, interfaces) {
+        xml += QString("<interface name=\"%1\">\n").arg(interface);
+        foreach (const QString &name, m_properties.value(interface).keys())
+            xml += QString("<property name=\"%1\" type=\"%2\" access=\"%3\"/>\n").arg(name, m_properties.value(interface).value(name).signature,
+                                                                                       m_properties.value(interface).value(name).writable ? "readwrite" : "read");
+
+        foreach (const QString &name, m_methods.value(interface).keys()) {
+            QString outSignature = m_methods.value(interface).value(name).outSignature;
+            if (outSignature.isEmpty()) {
+                xml += QString("<method name=\"%1\"/>\n").arg(name);
+            } else {
+                xml += QString("<method name=\"%1\"><arg type=\"%2\" direction=\"out\"/></method>\n").arg(name, outSignature);
+            }
+        }
+        xml += "</interface>\n";
+    }
+
+    return xml;
+}
+
+bool StubObject::handleMessage(const QDBusMessage &message, const QDBusConnection &connection)
+{
+    if (message.type() != QDBusMessage::MethodCallMessage)
+        return false;
+
+    QDBusMessage reply = createReply(message);
+    if (m_latency <= 0) {
+        connection.send(reply);
+        return true;
+    }
+
+    QDBusConnection replyConnection(connection);
+    QTimer::singleShot(m_latency, this, [replyConnection, reply]() {
+        replyConnection.send(reply);
+    });
+
+    return true;
+}
+
+QDBusMessage StubObject::createReply(const QDBusMessage &message)
+{
+    const QString interface = message.interface();
+    const QVariantList arguments = message.arguments();
+
+    if (interface == "org.freedesktop.DBus.Introspectable" && message.member() == "Introspect") {
+        QString xml = "<!DOCTYPE node PUBLIC \"-//freedesktop//DTD D-BUS Object Introspection 1.0//EN\" \"http://www.freedesktop.org/standards/dbus/1.0/introspect.dtd\">\n<node>\n";
+        xml += introspect(m_path);
+        xml += "</node>\n";
+        return message.createReply(xml);
+    }
+
+    if (interface == "org.freedesktop.DBus.Properties") {
+        QString propertyInterface = arguments.value(0).toString();
+        if (message.member() == "Get") {
+            QString name = arguments.value(1).toString();
+            if (!m_properties.value(propertyInterface).contains(name))
+                return message.createErrorReply(QDBusError::UnknownProperty, QString("No property %1 on %2").arg(name, propertyInterface));
+
+            return message.createReply(QVariant::fromValue(QDBusVariant(m_properties.value(propertyInterface).value(name).value)));
+        }
+
+        if (message.member() == "GetAll")
+            return message.createReply(properties(propertyInterface));
+
+        if (message.member() == "Set") {
+            QString name = arguments.value(1).toString();
+            if (!m_properties.value(propertyInterface).contains(name))
+                return message.createErrorReply(QDBusError::UnknownProperty, QString("No property %1 on %2").arg(name, propertyInterface));
+
+            if (!m_properties.value(propertyInterface).value(name).writable)
+                return message.createErrorReply(QDBusError::PropertyReadOnly, QString("The property %1 on %2 is read only").arg(name, propertyInterface));
+
+            m_properties[propertyInterface][name].value = arguments.value(2).value<QDBusVariant>().variant();
+            return message.createReply();
+        }
+
+        return message.createErrorReply(QDBusError::UnknownMethod, QString("No method %1 on %2").arg(message.member(), interface));
+    }
+
+    if (!m_methods.value(interface).contains(message.member()))
+        return message.createErrorReply(QDBusError::UnknownMethod, QString("No method %1 on %2").arg(message.member(), interface));
+
+    return message.createReply(m_methods.value(interface).value(message.member()).reply);
+}
@@ -0,0 +1,72 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef STUBOBJECT_H
+#define STUBOBJECT_H
+
+#include <QObject>
+#include <QVariant>
+#include <QDBusMessage>
+#include <QDBusConnection>
+#include <QDBusVirtualObject>
+
+// A D-Bus object with fixed method replies. Every call, including the introspection
+// and property access, is answered after the latency. Writable properties keep the set value.
+class StubObject : public QDBusVirtualObject
+{
+    Q_OBJECT
+public:
+    explicit StubObject(const QString &path, int latency, QObject *parent = nullptr);
+
+    QString path() const;
+
+    void addProperty(const QString &interface, const QString &name, const QString &signature, const QVariant &value, bool writable = false);
+    QVariantMap properties(const QString &interface) const;
+    void addMethod(const QString &interface, const QString &name, const QString &outSignature = QString(), const QVariantList &reply = QVariantList());
+
+    QString introspect(const QString &path) const override;
+    bool handleMessage(const QDBusMessage &message, const QDBusConnection &connection) override;
+
+private:
+    struct Property {
+        QString signature;
+        QVariant value;
+        bool writable;
+    };
+
+    struct Method {
+        QString outSignature;
+        QVariantList reply;
+    };
+
+    QString m_path;
+    int m_latency = 0;
+    QMap<QString, QMap<QString, Property>> m_properties;
+    QMap<QString, QMap<QString, Method>> m_methods;
+
+    QDBusMessage createReply(const QDBusMessage &message);
+
+};
+
+#endif // STUBOBJECT_H
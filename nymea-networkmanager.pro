@@ -1,2 +1,2 @@
 TEMPLATE=subdirs
-SUBDIRS += nymea-networkmanager
+SUBDIRS += nymea-networkmanager benchmarks tests
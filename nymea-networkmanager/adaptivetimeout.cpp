@@ -0,0 +1,162 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "adaptivetimeout.h"
+#include "core.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QJsonDocument>
+
+AdaptiveTimeout::AdaptiveTimeout()
+{
+
+}
+
+QString AdaptiveTimeout::stateFile() const
+{
+    return m_stateFile;
+}
+
+void AdaptiveTimeout::setStateFile(const QString &fileName)
+{
+    if (m_stateFile == fileName)
+        return;
+
+    m_stateFile = fileName;
+    load();
+}
+
+void AdaptiveTimeout::record(qint64 latency)
+{
+    m_samples.append(latency);
+    while (m_samples.count() > s_maxSamples)
+        m_samples.removeFirst();
+
+    if (m_expired > 0)
+        m_expired--;
+
+    updateHistogram();
+    save();
+}
+
+int AdaptiveTimeout::sampleCount() const
+{
+    return m_samples.count();
+}
+
+void AdaptiveTimeout::recordExpired()
+{
+    if (m_expired >= s_maxExpired)
+        return;
+
+    m_expired++;
+    save();
+}
+
+int AdaptiveTimeout::expiredCount() const
+{
+    return m_expired;
+}
+
+int AdaptiveTimeout::timeout(int fallback) const
+{
+    if (m_samples.count() < s_minSamples)
+        return fallback;
+
+    // The extension does not depend on the current window, repeated expiries can not ratchet it up
+    qint64 timeout = (m_histogram.valueAtPercentile(99) + s_margin + m_expired * s_expiredExtension + 999) / 1000;
+    return static_cast<int>(qBound<qint64>(s_minimumTimeout, timeout, s_maximumTimeout));
+}
+
+QVariantMap AdaptiveTimeout::toVariantMap() const
+{
+    QVariantMap map;
+    map.insert("samples", m_samples.count());
+    map.insert("expired", m_expired);
+    map.insert("p99", m_histogram.valueAtPercentile(99));
+    map.insert("timeout", timeout(-1));
+    return map;
+}
+
+void AdaptiveTimeout::load()
+{
+    m_samples.clear();
+    m_expired = 0;
+    if (!m_stateFile.isEmpty()) {
+        QFile file(m_stateFile);
+        if (file.open(QIODevice::ReadOnly)) {
+            QJsonParseError error;
+            QJsonDocument document = QJsonDocument::fromJson(file.readAll(), &error);
+            if (error.error != QJsonParseError::NoError) {
+                qCWarning(dcApplication()) << "Ignoring invalid client connect latencies in" << m_stateFile << error.errorString();
+            } else {
+                foreach (const QJsonValue &value, document.object().value("clientConnect").toArray()) {
+                    m_samples.append(static_cast<qint64>(value.toDouble()));
+                }
+                m_expired = qBound(0, document.object().value("expiredWindows").toInt(), static_cast<int>(s_maxExpired));
+                qCDebug(dcApplication()) << "Loaded" << m_samples.count() << "client connect latencies from" << m_stateFile;
+            }
+        }
+    }
+
+    while (m_samples.count() > s_maxSamples)
+        m_samples.removeFirst();
+
+    updateHistogram();
+}
+
+void AdaptiveTimeout::save() const
+{
+    if (m_stateFile.isEmpty())
+        return;
+
+    QDir().mkpath(QFileInfo(m_stateFile).absolutePath());
+
+    QJsonArray samples;
+    foreach (qint64 sample, m_samples)
+        samples.append(static_cast<double>(sample));
+
+    QJsonObject object;
+    object.insert("clientConnect", samples);
+    object.insert("expiredWindows", m_expired);
+
+    // Write to a temporary file first, a power loss must not leave a broken file behind
+    QSaveFile file(m_stateFile);
+    if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(object).toJson(QJsonDocument::Compact)) < 0 || !file.commit()) {
+        qCWarning(dcApplication()) << "Could not save the client connect latencies to" << m_stateFile << file.errorString();
+    }
+}
+
+void AdaptiveTimeout::updateHistogram()
+{
+    m_histogram.reset();
+    foreach (qint64 sample, m_samples)
+        m_histogram.record(sample);
+}
@@ -0,0 +1,79 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef ADAPTIVETIMEOUT_H
+#define ADAPTIVETIMEOUT_H
+
+#include <QList>
+#include <QString>
+#include <QVariantMap>
+
+#include "latencyhistogram.h"
+
+// Derives the advertising timeout from the observed client connect latencies: the
+// 99th percentile plus a margin. Recently expired windows extend it slightly, up to
+// a fixed limit. The latest samples are kept in a small state file in order to
+// survive restarts.
+class AdaptiveTimeout
+{
+public:
+    AdaptiveTimeout();
+
+    QString stateFile() const;
+    void setStateFile(const QString &fileName);
+
+    void record(qint64 latency);
+    int sampleCount() const;
+
+    // A window expired without a client, each real latency takes one back
+    void recordExpired();
+    int expiredCount() const;
+
+    // In seconds, the fallback is used until enough samples have been recorded
+    int timeout(int fallback) const;
+
+    QVariantMap toVariantMap() const;
+
+private:
+    static const int s_maxSamples = 256;
+    static const int s_minSamples = 10;
+    static const int s_margin = 15000;
+    static const int s_minimumTimeout = 10;
+    static const int s_maximumTimeout = 600;
+    static const int s_maxExpired = 10;
+    static const int s_expiredExtension = 1500;
+
+    QString m_stateFile;
+    QList<qint64> m_samples;
+    int m_expired = 0;
+    LatencyHistogram m_histogram;
+
+    void load();
+    void save() const;
+    void updateHistogram();
+
+};
+
+#endif // ADAPTIVETIMEOUT_H
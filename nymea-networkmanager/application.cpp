@@ -26,54 +26,81 @@
 #include "core.h"
 
 #include <signal.h>
+#include <unistd.h>
+#include <sys/socket.h>
 
 static bool s_aboutToShutdown = false;
 
-static void catchUnixSignals(const std::vector<int>& quitSignals, const std::vector<int>& ignoreSignals = std::vector<int>())
+// The signal handlers only write the signal number to this socket pair, the event loop handles it
+static int s_signalSockets[2] = { -1, -1 };
+
+static void signalHandler(int sig)
 {
-    auto handler = [](int sig) ->void {
-        switch (sig) {
-        case SIGQUIT:
-            qCDebug(dcApplication()) << "Cought SIGQUIT quit signal...";
-            break;
-        case SIGINT:
-            qCDebug(dcApplication()) << "Cought SIGINT quit signal...";
-            break;
-        case SIGTERM:
-            qCDebug(dcApplication()) << "Cought SIGTERM quit signal...";
-            break;
-        case SIGHUP:
-            qCDebug(dcApplication()) << "Cought SIGHUP quit signal...";
-            break;
-        default:
-            qCDebug(dcApplication()) << "Cought unhandled signal" << sig;
-            break;
-        }
-
-        if (s_aboutToShutdown) {
-            qCCritical(dcApplication()) << "Already shutting down.";
-            return;
-        }
-
-        qCDebug(dcApplication()) << "=====================================";
-        qCDebug(dcApplication()) << "Shutting down nymea-networkmanager";
-        qCDebug(dcApplication()) << "=====================================";
-        s_aboutToShutdown = true;
-
-        Application::quit();
-    };
+    char byte = static_cast<char>(sig);
+    ssize_t result = ::write(s_signalSockets[0], &byte, sizeof(byte));
+    Q_UNUSED(result)
+}
 
+static void catchUnixSignals(const std::vector<int>& handledSignals, const std::vector<int>& ignoreSignals = std::vector<int>())
+{
     // all these signals will be ignored.
     for (int sig : ignoreSignals)
         signal(sig, SIG_IGN);
 
-    for (int sig : quitSignals)
-        signal(sig, handler);
+    for (int sig : handledSignals)
+        signal(sig, signalHandler);
 
 }
 
 Application::Application(int &argc, char **argv) :
     QCoreApplication(argc, argv)
 {
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, s_signalSockets) != 0) {
+        qCWarning(dcApplication()) << "Could not create socket pair for the unix signals. Reloading the configuration on SIGHUP is not available.";
+        return;
+    }
+
+    m_signalNotifier = new QSocketNotifier(s_signalSockets[1], QSocketNotifier::Read, this);
+    connect(m_signalNotifier, &QSocketNotifier::activated, this, &Application::onSignalNotifierActivated);
     catchUnixSignals({SIGQUIT, SIGINT, SIGTERM, SIGHUP});
 }
+
+void Application::onSignalNotifierActivated()
+{
+    char byte;
+    ssize_t result = ::read(s_signalSockets[1], &byte, sizeof(byte));
+    if (result != sizeof(byte))
+        return;
+
+    int sig = byte;
+    switch (sig) {
+    case SIGHUP:
+        qCDebug(dcApplication()) << "Cought SIGHUP signal. Reloading configuration...";
+        emit reloadRequested();
+        return;
+    case SIGQUIT:
+        qCDebug(dcApplication()) << "Cought SIGQUIT quit signal...";
+        break;
+    case SIGINT:
+        qCDebug(dcApplication()) << "Cought SIGINT quit signal...";
+        break;
+    case SIGTERM:
+        qCDebug(dcApplication()) << "Cought SIGTERM quit signal...";
+        break;
+    default:
+        qCDebug(dcApplication()) << "Cought unhandled signal" << sig;
+        break;
+    }
+
+    if (s_aboutToShutdown) {
+        qCCritical(dcApplication()) << "Already shutting down.";
+        return;
+    }
+
+    qCDebug(dcApplication()) << "=====================================";
+    qCDebug(dcApplication()) << "Shutting down nymea-networkmanager";
+    qCDebug(dcApplication()) << "=====================================";
+    s_aboutToShutdown = true;
+
+    Application::quit();
+}
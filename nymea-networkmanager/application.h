@@ -26,6 +26,7 @@
 #define APPLICATION_H
 
 #include <QObject>
+#include <QSocketNotifier>
 #include <QCoreApplication>
 
 
@@ -35,6 +36,15 @@ class Application : public QCoreApplication
 public:
     explicit Application(int &argc, char **argv);
 
+signals:
+    void reloadRequested();
+
+private:
+    QSocketNotifier *m_signalNotifier = nullptr;
+
+private slots:
+    void onSignalNotifierActivated();
+
 };
 
 #endif // APPLICATION_H
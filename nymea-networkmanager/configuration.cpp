@@ -0,0 +1,342 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "configuration.h"
+
+#include <QMetaEnum>
+#include <QSettings>
+#include <QCommandLineParser>
+#include <QFileInfo>
+#include <QStandardPaths>
+
+template <int Configuration::*field>
+static bool parseInt(Configuration *configuration, const Configuration::Key &key, const QVariant &value, QString *errorString)
+{
+    bool valueOk = false;
+    int number = value.toInt(&valueOk);
+    if (!valueOk || number < key.minimum) {
+        *errorString = QString("Invalid %1 value passed: \"%2\". Please pass an integer >= %3").arg(key.name).arg(value.toString()).arg(key.minimum);
+        return false;
+    }
+
+    configuration->*field = number;
+    return true;
+}
+
+template <bool Configuration::*field>
+static bool parseBool(Configuration *configuration, const Configuration::Key &key, const QVariant &value, QString *errorString)
+{
+    QString valueString = value.toString().toLower();
+    if (valueString == "true" || valueString == "1" || valueString == "yes") {
+        configuration->*field = true;
+    } else if (valueString == "false" || valueString == "0" || valueString == "no") {
+        configuration->*field = false;
+    } else {
+        *errorString = QString("Invalid %1 value passed: \"%2\". Please pass \"true\" or \"false\"").arg(key.name).arg(value.toString());
+        return false;
+    }
+
+    return true;
+}
+
+template <QString Configuration::*field>
+static bool parseString(Configuration *configuration, const Configuration::Key &key, const QVariant &value, QString *errorString)
+{
+    Q_UNUSED(key)
+    Q_UNUSED(errorString)
+    configuration->*field = value.toString();
+    return true;
+}
+
+// The allowed values are the keys of the enum without the enum name, i.e. "offline" for ModeOffline
+template <typename T>
+static QStringList enumValues()
+{
+    QMetaEnum metaEnum = QMetaEnum::fromType<T>();
+    int prefixLength = qstrlen(metaEnum.name());
+
+    QStringList values;
+    for (int i = 0; i < metaEnum.keyCount(); i++)
+        values.append(QString(metaEnum.key(i)).mid(prefixLength).toLower());
+
+    return values;
+}
+
+template <typename T, T Configuration::*field>
+static bool parseEnum(Configuration *configuration, const Configuration::Key &key, const QVariant &value, QString *errorString)
+{
+    QMetaEnum metaEnum = QMetaEnum::fromType<T>();
+    QStringList allowedValues = enumValues<T>();
+    int index = allowedValues.indexOf(value.toString().toLower());
+    if (index >= 0) {
+        configuration->*field = static_cast<T>(metaEnum.value(index));
+        return true;
+    }
+
+    *errorString = QString("Invalid %1 value passed: \"%2\". Please pass one of \"%3\"").arg(key.name).arg(value.toString()).arg(allowedValues.join("\", \""));
+    return false;
+}
+
+static bool parseSchedule(Configuration *configuration, const Configuration::Key &key, const QVariant &value, QString *errorString)
+{
+    configuration->scheduleStart = QTime();
+    configuration->scheduleEnd = QTime();
+    if (value.toString().isEmpty())
+        return true;
+
+    QStringList times = value.toString().split('-');
+    if (times.count() == 2) {
+        configuration->scheduleStart = QTime::fromString(times.at(0).trimmed(), "HH:mm");
+        configuration->scheduleEnd = QTime::fromString(times.at(1).trimmed(), "HH:mm");
+    }
+
+    if (!configuration->scheduleStart.isValid() || !configuration->scheduleEnd.isValid()) {
+        *errorString = QString("Invalid %1 value passed: \"%2\". Please pass a time range like \"08:00-18:00\"").arg(key.name).arg(value.toString());
+        return false;
+    }
+
+    return true;
+}
+
+Configuration::Configuration()
+{
+    QString errorString;
+    for (const Key &key : schema()) {
+        bool defaultValid = key.parse(this, key, QString(key.defaultValue), &errorString);
+        Q_ASSERT_X(defaultValid, key.name, qPrintable(errorString));
+        Q_UNUSED(defaultValid)
+    }
+}
+
+const QList<Configuration::Key> &Configuration::schema()
+{
+    static const QList<Key> keys = {
+        { "Mode", "mode", "m", "MODE", "offline", 0, FlagRuntime,
+          parseEnum<Core::Mode, &Configuration::mode>, enumValues<Core::Mode>,
+          "Run the daemon in a specific mode." },
+        { "Timeout", "timeout", "t", "SECONDS", "60", 10, FlagRuntime,
+          parseInt<&Configuration::timeout>, nullptr,
+          "The timeout of the bluetooth server in seconds." },
+        { "TimeoutPolicy", nullptr, nullptr, nullptr, "fixed", 0, FlagRuntime,
+          parseEnum<Core::TimeoutPolicy, &Configuration::timeoutPolicy>, enumValues<Core::TimeoutPolicy>, nullptr },
+        { "MaxSessions", nullptr, nullptr, nullptr, "1", 1, FlagRuntime,
+          parseInt<&Configuration::maxSessions>, nullptr, nullptr },
+        { "OfflineDebounceMs", nullptr, nullptr, nullptr, "1000", 0, FlagRuntime,
+          parseInt<&Configuration::offlineDebounce>, nullptr, nullptr },
+        { "NymeaCallTimeoutMs", nullptr, nullptr, nullptr, "5000", 100, FlagNone,
+          parseInt<&Configuration::nymeaCallTimeout>, nullptr, nullptr },
+        { "IdleExit", nullptr, nullptr, nullptr, "false", 0, FlagNone,
+          parseBool<&Configuration::idleExit>, nullptr, nullptr },
+        { "DutyCycleOn", nullptr, nullptr, nullptr, "0", 0, FlagRuntime,
+          parseInt<&Configuration::dutyCycleOn>, nullptr, nullptr },
+        { "DutyCycleOff", nullptr, nullptr, nullptr, "0", 0, FlagRuntime,
+          parseInt<&Configuration::dutyCycleOff>, nullptr, nullptr },
+        { "AdvertisingSchedule", nullptr, nullptr, nullptr, "", 0, FlagRuntime,
+          parseSchedule, nullptr, nullptr },
+        { "AdvertiseName", "advertise-name", "a", "NAME", "BT-WiFi", 0, FlagRuntime,
+          parseString<&Configuration::advertiseName>, nullptr,
+          "The name of the bluetooth server. NOTE: The length is limited to 8 characters." },
+        { "ForceFullName", "force-name", "f", nullptr, "false", 0, FlagRuntime | FlagSwitch,
+          parseBool<&Configuration::forceFullName>, nullptr,
+          "Enforce the full name to be used even if it is longer than 8 characters. IMPORTANT: This will displace the Service UUID in the discovery data "
+          "which implies that client applications cannot discover the wifi setup service on this device any more." },
+        { "PlatformName", "platform-name", "p", "NAME", "nymea", 0, FlagRuntime,
+          parseString<&Configuration::platformName>, nullptr,
+          "The name of the platform this daemon is running." },
+        { "ButtonGpio", "gpio", "g", "GPIO", "-1", -1, FlagNone,
+          parseInt<&Configuration::buttonGpio>, nullptr,
+          "The GPIO sysfs number for the button GPIO. This parameter is only needed for the \"button\" mode." },
+        { "ButtonActiveLow", nullptr, nullptr, nullptr, "false", 0, FlagNone,
+          parseBool<&Configuration::buttonActiveLow>, nullptr, nullptr },
+        { "ButtonChip", nullptr, nullptr, nullptr, "", 0, FlagNone,
+          parseString<&Configuration::buttonChip>, nullptr, nullptr },
+        { "ButtonLongPressMs", nullptr, nullptr, nullptr, "2000", 100, FlagNone,
+          parseInt<&Configuration::buttonLongPress>, nullptr, nullptr },
+        { "ButtonDebounceMs", nullptr, nullptr, nullptr, "50", 0, FlagNone,
+          parseInt<&Configuration::buttonDebounce>, nullptr, nullptr },
+        { "DBusBusType", "dbus-type", "b", "DBUSTYPE", "", 0, FlagNone,
+          parseString<&Configuration::dbusBusType>, nullptr,
+          "If given, a DBus interface will be exposed on the chosen DBus bus type (session, system)." },
+        { "ScanMaxAge", nullptr, nullptr, nullptr, "0", 0, FlagRuntime,
+          parseInt<&Configuration::scanMaxAge>, nullptr, nullptr },
+        { "NetworkManagerProfile", nullptr, nullptr, nullptr, "full", 0, FlagNone,
+          parseEnum<Core::NetworkManagerProfile, &Configuration::networkManagerProfile>, enumValues<Core::NetworkManagerProfile>, nullptr },
+        { "StateDirectory", nullptr, nullptr, nullptr, "/var/lib/nymea-networkmanager", 0, FlagNone,
+          parseString<&Configuration::stateDirectory>, nullptr, nullptr }
+    };
+
+    return keys;
+}
+
+const Configuration::Key *Configuration::findKey(const QString &name)
+{
+    for (const Key &key : schema()) {
+        if (name == key.name)
+            return &key;
+    }
+
+    return nullptr;
+}
+
+QString Configuration::findConfigurationFile()
+{
+    QStringList configLocations;
+    configLocations << QStandardPaths::standardLocations(QStandardPaths::ConfigLocation);
+    configLocations << "/etc";
+    QString fileName = "/nymea/nymea-networkmanager.conf";
+    foreach (const QString &configLocation, configLocations) {
+        if (QFileInfo::exists(configLocation + fileName)) {
+            return configLocation + fileName;
+        }
+    }
+
+    return QString();
+}
+
+void Configuration::addCommandLineOptions(QCommandLineParser *parser)
+{
+    for (const Key &key : schema()) {
+        if (!key.option)
+            continue;
+
+        QStringList names;
+        if (key.alias)
+            names << key.alias;
+        names << key.option;
+
+        QString description = key.description;
+        if (key.allowedValues)
+            description += QString(" One of \"%1\".").arg(key.allowedValues().join("\", \""));
+
+        if (key.minimum > 0)
+            description += QString(" Minimum value is %1.").arg(key.minimum);
+
+        if (key.flags & FlagSwitch) {
+            parser->addOption(QCommandLineOption(names, description));
+            continue;
+        }
+
+        if (qstrlen(key.defaultValue) > 0)
+            description += QString(" Default \"%1\".").arg(key.defaultValue);
+
+        parser->addOption(QCommandLineOption(names, description, key.valueName, key.defaultValue));
+    }
+}
+
+QVariantMap Configuration::commandLineOverrides(const QCommandLineParser &parser)
+{
+    QVariantMap overrides;
+    for (const Key &key : schema()) {
+        if (!key.option || !parser.isSet(key.option))
+            continue;
+
+        if (key.flags & FlagSwitch) {
+            overrides.insert(key.name, true);
+        } else {
+            overrides.insert(key.name, parser.value(key.option));
+        }
+    }
+
+    return overrides;
+}
+
+bool Configuration::load(const QString &fileName, const QVariantMap &overrides)
+{
+    QVariantMap fileValues;
+    if (!fileName.isEmpty()) {
+        QSettings settings(fileName, QSettings::IniFormat);
+        foreach (const QString &key, settings.allKeys()) {
+            fileValues.insert(key, settings.value(key));
+        }
+    }
+
+    return loadValues(fileValues, overrides);
+}
+
+bool Configuration::loadValues(const QVariantMap &fileValues, const QVariantMap &overrides)
+{
+    // Start over from the defaults, removed keys fall back to them
+    *this = Configuration();
+    m_fileValues = fileValues;
+
+    QVariantMap values = fileValues;
+
+    // Command line values replace the file values
+    foreach (const QString &key, overrides.keys()) {
+        values.insert(key, overrides.value(key));
+    }
+
+    // Each value gets parsed once, straight into its member
+    foreach (const QString &name, values.keys()) {
+        const Key *key = findKey(name);
+        if (!key) {
+            // A typo in a runtime value should not go unnoticed, the file may be shared with newer versions
+            if (overrides.contains(name)) {
+                m_errorString = QString("Unknown configuration key \"%1\".").arg(name);
+                return false;
+            }
+
+            qCWarning(dcApplication()) << "Ignoring the unknown configuration key" << name;
+            continue;
+        }
+
+        if (key->parse(this, *key, values.value(name), &m_errorString))
+            continue;
+
+        // An unknown mode in the file is not fatal, the default mode will be used
+        if (name == "Mode" && !overrides.contains(name)) {
+            qCWarning(dcApplication()).noquote() << QString("The config file's mode \"%1\" does not match the allowed modes.").arg(values.value(name).toString());
+            m_errorString.clear();
+            continue;
+        }
+
+        return false;
+    }
+
+    // All parsed. Validate the values depending on each other:
+
+    // Line offsets of a GPIO chip start at 0, sysfs GPIO numbers at 1
+    if (mode == Core::ModeButton && (buttonChip.isEmpty() ? buttonGpio <= 0 : buttonGpio < 0)) {
+        m_errorString = "Button mode selected but no valid GPIO passed. The button will not work!";
+        return false;
+    }
+
+    if (!dbusBusType.isEmpty() && dbusBusType != "system" && dbusBusType != "session" && dbusBusType != "none") {
+        m_errorString = QString("Invalid DBus bus type: \"%1\"").arg(dbusBusType);
+        return false;
+    }
+
+    return true;
+}
+
+QVariantMap Configuration::fileValues() const
+{
+    return m_fileValues;
+}
+
+QString Configuration::errorString() const
+{
+    return m_errorString;
+}
@@ -0,0 +1,116 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef CONFIGURATION_H
+#define CONFIGURATION_H
+
+#include <QTime>
+#include <QString>
+#include <QStringList>
+#include <QVariantMap>
+
+#include "core.h"
+
+class QCommandLineParser;
+
+// The daemon configuration, read from the configuration file with the command line
+// values on top. Core can apply a new configuration while running.
+class Configuration
+{
+public:
+    Configuration();
+
+    // The defaults are part of the schema
+    Core::Mode mode;
+    int timeout;
+    Core::TimeoutPolicy timeoutPolicy;
+    int offlineDebounce;
+    int nymeaCallTimeout;
+    int maxSessions;
+    bool idleExit;
+    int dutyCycleOn;
+    int dutyCycleOff;
+    QTime scheduleStart;
+    QTime scheduleEnd;
+    int buttonGpio;
+    bool buttonActiveLow;
+    QString buttonChip;
+    int buttonLongPress;
+    int buttonDebounce;
+    QString advertiseName;
+    bool forceFullName;
+    QString platformName;
+    QString dbusBusType;
+    QString stateDirectory;
+    int scanMaxAge;
+    Core::NetworkManagerProfile networkManagerProfile;
+
+    enum Flag {
+        FlagNone = 0x0,
+        FlagRuntime = 0x1,      // May be changed at runtime over D-Bus with applyBatch
+        FlagSwitch = 0x2        // The command line option takes no value, it sets the key to true
+    };
+
+    // One key of the configuration schema, the single description of its type,
+    // default, range and command line option.
+    struct Key {
+        const char *name;           // The key in the configuration file
+        const char *option;         // The long command line option, nullptr if there is none
+        const char *alias;          // The short command line option, nullptr if there is none
+        const char *valueName;      // The value name in the command line help
+        const char *defaultValue;   // Parsed like a value from the configuration file
+        int minimum;                // Only used by integer keys
+        int flags;
+        bool (*parse)(Configuration *configuration, const Key &key, const QVariant &value, QString *errorString);
+        QStringList (*allowedValues)();     // The values of enum keys, nullptr for the others
+        const char *description;    // The command line help, nullptr if there is no option
+    };
+
+    static const QList<Key> &schema();
+    static const Key *findKey(const QString &name);
+    static QString findConfigurationFile();
+
+    // Registers the command line options of the schema keys, commandLineOverrides() queries exactly these
+    static void addCommandLineOptions(QCommandLineParser *parser);
+
+    // The configuration file keys of the options given on the command line with their values
+    static QVariantMap commandLineOverrides(const QCommandLineParser &parser);
+
+    // The overrides use the configuration file keys and have the higher priority
+    bool load(const QString &fileName, const QVariantMap &overrides = QVariantMap());
+
+    // Like load(), with the values of the file as they were read by an earlier load()
+    bool loadValues(const QVariantMap &fileValues, const QVariantMap &overrides = QVariantMap());
+    QVariantMap fileValues() const;
+
+    QString errorString() const;
+
+private:
+    QString m_errorString;
+    QVariantMap m_fileValues;
+
+};
+
+#endif // CONFIGURATION_H
@@ -23,12 +23,72 @@
 * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include "core.h"
+#include "configuration.h"
+#include "loopwatchdog.h"
+#include "memoryreport.h"
 #include "nymeanetworkmanagerdbusservice.h"
 
 #include <QTimer>
+#include <QFileInfo>
+#include <QJsonDocument>
+#include <QCoreApplication>
+#include <QMetaEnum>
+#include <QBluetoothLocalDevice>
+
+#include <systemd/sd-daemon.h>
 
 Q_LOGGING_CATEGORY(dcApplication, "Application")
 
+// The grace period for bluez to clean up before the server gets restarted in "always" mode
+static const int s_restartGracePeriod = 3000;
+
+// Let pending D-Bus calls finish and the state settle before exiting because there is nothing left to do
+static const int s_idleExitDelay = 5000;
+
+// The heartbeat interval of the event loop watchdog while measuring the startup
+static const int s_measurementHeartbeatInterval = 10;
+
+// Give up the measurement if the server did not advertise (and stop for the benchmark) within this time
+static const int s_benchmarkTimeout = 60000;
+
+// Keep the latest transitions for the D-Bus interface
+static const int s_transitionHistorySize = 64;
+static const int s_sessionHistorySize = 16;
+
+// All valid state transitions, events not listed for the current state are ignored
+struct StateTransition {
+    Core::State from;
+    Core::Event event;
+    Core::State to;
+};
+
+static constexpr StateTransition s_stateTransitions[] = {
+    { Core::StateWaiting,     Core::EventNetworkManagerAvailable,   Core::StateIdle },
+    { Core::StateIdle,        Core::EventNetworkManagerUnavailable, Core::StateWaiting },
+    { Core::StateIdle,        Core::EventStartRequested,            Core::StateStarting },
+    { Core::StateIdle,        Core::EventRestartRequested,          Core::StateCoolingDown },
+    { Core::StateIdle,        Core::EventServerStarted,             Core::StateAdvertising },
+    { Core::StateIdle,        Core::EventFinished,                  Core::StateFinished },
+    { Core::StateFinished,    Core::EventReset,                     Core::StateIdle },
+    { Core::StateFinished,    Core::EventStartRequested,            Core::StateStarting },   // Only requested over D-Bus
+    { Core::StateStarting,    Core::EventServerStarted,             Core::StateAdvertising },
+    { Core::StateStarting,    Core::EventStartFailed,               Core::StateIdle },
+    { Core::StateStarting,    Core::EventServerStopped,             Core::StateIdle },
+    { Core::StateStarting,    Core::EventStopRequested,             Core::StateStopping },
+    { Core::StateAdvertising, Core::EventClientConnected,           Core::StateConnected },
+    { Core::StateAdvertising, Core::EventStopRequested,             Core::StateStopping },
+    { Core::StateAdvertising, Core::EventServerStopped,             Core::StateIdle },
+    { Core::StateConnected,   Core::EventClientDisconnected,        Core::StateAdvertising },
+    { Core::StateConnected,   Core::EventStopRequested,             Core::StateStopping },
+    { Core::StateConnected,   Core::EventServerStopped,             Core::StateIdle },
+    { Core::StateStopping,    Core::EventServerStarted,             Core::StateStopping },
+    { Core::StateStopping,    Core::EventServerStopped,             Core::StateIdle },
+    { Core::StateCoolingDown, Core::EventCooldownElapsed,           Core::StateStarting },
+    { Core::StateCoolingDown, Core::EventStartRequested,            Core::StateStarting },
+    { Core::StateCoolingDown, Core::EventStopRequested,             Core::StateIdle },
+    { Core::StateCoolingDown, Core::EventNetworkManagerUnavailable, Core::StateWaiting }
+};
+
 NetworkManager *Core::networkManager() const
 {
     return m_networkManager;
@@ -44,6 +104,11 @@ NymeadService *Core::nymeaService() const
     return m_nymeaService;
 }
 
+const ProvisioningMetrics &Core::metrics() const
+{
+    return m_metrics;
+}
+
 Core::Mode Core::mode() const
 {
     return m_mode;
@@ -51,7 +116,51 @@ Core::Mode Core::mode() const
 
 void Core::setMode(Mode mode)
 {
+    if (m_mode == mode)
+        return;
+
     m_mode = mode;
+    emit modeChanged(m_mode);
+}
+
+Core::State Core::state() const
+{
+    return m_state;
+}
+
+int Core::remainingAdvertisingTime() const
+{
+    if (!m_advertisingTimer->isActive())
+        return -1;
+
+    return m_advertisingTimer->remainingTime() / 1000;
+}
+
+QVariantList Core::transitionHistory() const
+{
+    QVariantList transitions;
+    foreach (const Transition &transition, m_transitions) {
+        QVariantMap transitionMap;
+        transitionMap.insert("timestamp", transition.timestamp);
+        transitionMap.insert("from", QMetaEnum::fromType<State>().valueToKey(transition.from));
+        transitionMap.insert("to", QMetaEnum::fromType<State>().valueToKey(transition.to));
+        transitionMap.insert("event", QMetaEnum::fromType<Event>().valueToKey(transition.event));
+        transitions.append(transitionMap);
+    }
+    return transitions;
+}
+
+QVariantList Core::sessionHistory() const
+{
+    QVariantList sessions;
+    foreach (const Session &session, m_sessions) {
+        QVariantMap sessionMap;
+        sessionMap.insert("timestamp", session.started);
+        sessionMap.insert("duration", session.duration);
+        sessionMap.insert("online", session.online);
+        sessions.append(sessionMap);
+    }
+    return sessions;
 }
 
 QString Core::advertiseName() const
@@ -85,278 +194,1494 @@ void Core::setAdvertisingTimeout(int advertisingTimeout)
     m_advertisingTimeout = advertisingTimeout;
 }
 
-void Core::addGPioButton(int buttonGpio, bool activeLow)
+int Core::maxSessions() const
 {
-    if (buttonGpio < 0) {
-        qCDebug(dcApplication()) << "No button GPIO specified. Skip creating GPIO button ...";
-        return;
-    }
+    return m_maxSessions;
+}
 
-    GpioButton *button = new GpioButton(buttonGpio, this);
-    button->setActiveLow(activeLow);
-    button->setLongPressedTimeout(2000);
-    connect(button, &GpioButton::longPressed, this, &Core::startService);
-    m_buttons.append(button);
+void Core::setMaxSessions(int maxSessions)
+{
+    m_maxSessions = maxSessions;
 }
 
-void Core::enableDBusInterface(QDBusConnection::BusType busType)
+Core::TimeoutPolicy Core::timeoutPolicy() const
 {
-    NymeaNetworkManagerDBusService *dbusService = new NymeaNetworkManagerDBusService(busType, this);
+    return m_timeoutPolicy;
+}
 
-    // Deprecated
-    connect(dbusService, &NymeaNetworkManagerDBusService::enableBluetoothServerCalled, this,  &Core::onDBusStartRequested);
+void Core::setTimeoutPolicy(TimeoutPolicy timeoutPolicy)
+{
+    m_timeoutPolicy = timeoutPolicy;
+}
 
-    connect(dbusService, &NymeaNetworkManagerDBusService::startBluetoothServerRequested, this, &Core::onDBusStartRequested);
-    connect(dbusService, &NymeaNetworkManagerDBusService::stopBluetoothServerRequested, this, &Core::onDBusStopRequested);
+const AdaptiveTimeout &Core::adaptiveTimeout() const
+{
+    return m_adaptiveTimeout;
 }
 
-void Core::run()
+int Core::scanMaxAge() const
 {
-    // Start the networkmanager
-    m_networkManager->start();
+    return m_scanMaxAge;
 }
 
-Core::Core(QObject *parent) :
-    QObject(parent)
+void Core::setScanMaxAge(int scanMaxAge)
 {
-    m_networkManager = new NetworkManager(this);
-    connect(m_networkManager, &NetworkManager::availableChanged, this, &Core::onNetworkManagerAvailableChanged);
-    connect(m_networkManager, &NetworkManager::stateChanged, this, &Core::onNetworkManagerStateChanged);
+    m_scanMaxAge = scanMaxAge;
+    if (m_scanMaxAge <= 0) {
+        m_scanTimer->stop();
+    } else if (m_scanTimer->isActive()) {
+        m_scanTimer->start(m_scanMaxAge * 1000);
+    }
+}
 
-    m_bluetoothServer = new BluetoothServer(m_networkManager);
+Core::NetworkManagerProfile Core::networkManagerProfile() const
+{
+    return m_networkManagerProfile;
+}
 
-    connect(m_bluetoothServer, &BluetoothServer::runningChanged, this, &Core::onBluetoothServerRunningChanged, Qt::QueuedConnection);
-    connect(m_bluetoothServer, &BluetoothServer::connectedChanged, this, &Core::onBluetoothServerConnectedChanged, Qt::QueuedConnection);
+void Core::setNetworkManagerProfile(NetworkManagerProfile networkManagerProfile)
+{
+    m_networkManagerProfile = networkManagerProfile;
+}
 
-    m_nymeaService = new NymeadService(false, this);
-    connect(m_nymeaService, &NymeadService::availableChanged, this, &Core::onNymeaServiceAvailableChanged);
+QString Core::stateDirectory() const
+{
+    return m_stateDirectory;
+}
 
-    m_advertisingTimer = new QTimer(this);
-    m_advertisingTimer->setSingleShot(true);
-    connect(m_advertisingTimer, &QTimer::timeout, this, &Core::onAdvertisingTimeout);
+void Core::setStateDirectory(const QString &stateDirectory)
+{
+    m_stateDirectory = stateDirectory;
+    m_adaptiveTimeout.setStateFile(m_stateDirectory.isEmpty() ? QString() : m_stateDirectory + "/connect-latency.json");
+    m_networkSnapshot.setStateFile(m_stateDirectory.isEmpty() ? QString() : m_stateDirectory + "/network-snapshot.json");
 }
 
-Core::~Core()
+int Core::offlineDebounce() const
 {
-    qCDebug(dcApplication()) << "Shutting down nymea service";
-    delete m_nymeaService;
-    m_nymeaService = nullptr;
+    return m_offlineDebounce;
+}
 
-    qCDebug(dcApplication()) << "Shutting down bluetooth service";
-    delete m_bluetoothServer;
-    m_bluetoothServer = nullptr;
+void Core::setOfflineDebounce(int offlineDebounce)
+{
+    m_offlineDebounce = offlineDebounce;
+}
 
-    qCDebug(dcApplication()) << "Shutting down network-manager service";
-    delete m_networkManager;
-    m_networkManager = nullptr;
+bool Core::idleExit() const
+{
+    return m_idleExit;
 }
 
-void Core::evaluateNetworkManagerState(NetworkManager::NetworkManagerState state)
+void Core::setIdleExit(bool idleExit)
 {
-    if (m_mode != ModeOffline)
-        return;
+    m_idleExit = idleExit;
+}
 
-    // Note: if the wireless device is in the access point mode, the bluetooth server should stop
-    if (m_wirelessDevice && m_wirelessDevice->wirelessMode() == WirelessNetworkDevice::WirelessModeAccessPoint) {
-        stopService();
-        return;
-    }
+int Core::dutyCycleOn() const
+{
+    return m_dutyCycleOn;
+}
 
-    switch (state) {
-    case NetworkManager::NetworkManagerStateConnectedGlobal:
-        // We are online
-        qCDebug(dcApplication()) << "Not advertising bluetooth because we are online and we are running in" << m_mode;
-        if (m_bluetoothServer->running() && !m_bluetoothServer->connected()) {
-            qCDebug(dcApplication()) << "Stop the bluetooth service because of \"offline\" mode.";
-            stopService();
-        }
-        break;
-    case NetworkManager::NetworkManagerStateConnectedSite:
-        // We are somehow in the network
-        if (m_bluetoothServer->running() && !m_bluetoothServer->connected()) {
-            qCDebug(dcApplication()) << "Stop the bluetooth service because of \"offline\" mode.";
-            stopService();
-        }
-        break;
-    case NetworkManager::NetworkManagerStateUnknown:
-    case NetworkManager::NetworkManagerStateAsleep:
-    case NetworkManager::NetworkManagerStateDisconnected:
-    case NetworkManager::NetworkManagerStateConnectedLocal:
-        if (m_networkManager->available()) {
-            // Everything else is not connected, start the service
-            qCDebug(dcApplication()) << "Start the bluetooth service because of \"offline\" mode.";
-            startService();
-        } else {
-            qCDebug(dcApplication()) << "Not starting the service yet because the networkmanager is not available.";
-        }
-        break;
-    default:
-        qCDebug(dcApplication()) << "Ignoring" << state;
-        break;
-    }
+int Core::dutyCycleOff() const
+{
+    return m_dutyCycleOff;
 }
 
-void Core::startService()
+void Core::setDutyCycle(int onSeconds, int offSeconds)
 {
-    if (!m_networkManager->available()) {
-        qCWarning(dcApplication()) << "Could not start services. There is no network manager available.";
+    m_dutyCycleOn = onSeconds;
+    m_dutyCycleOff = offSeconds;
+}
+
+void Core::setAdvertisingSchedule(const QTime &start, const QTime &end)
+{
+    m_scheduleStart = start;
+    m_scheduleEnd = end;
+}
+
+void Core::addGPioButton(int buttonGpio, bool activeLow)
+{
+    if (buttonGpio < 0) {
+        qCDebug(dcApplication()) << "No button GPIO specified. Skip creating GPIO button ...";
         return;
     }
 
-    // Verify if we have a wireless network available
-    if (!m_networkManager->wirelessAvailable()) {
-        qCWarning(dcApplication()) << "Could not start services. There is no wireless device available.";
+    // All lines of the character device get watched through one request
+    if (!m_buttonChip.isEmpty()) {
+        if (!m_gpioInputEngine) {
+            m_gpioInputEngine = new GpioInputEngine(m_buttonChip, this);
+            connect(m_gpioInputEngine, &GpioInputEngine::longPressed, this, &Core::onButtonLongPressed);
+        }
+
+        m_gpioInputEngine->addButton(static_cast<uint>(buttonGpio), activeLow, m_buttonLongPress, m_buttonDebounce);
         return;
     }
 
-    // Disable bluetooth on nymea in order to not crash with client connections
-    m_nymeaService->enableBluetooth(false);
+    GpioButton *button = new GpioButton(buttonGpio, this);
+    button->setActiveLow(activeLow);
+    button->setLongPressedTimeout(m_buttonLongPress);
+    connect(button, &GpioButton::longPressed, this, &Core::onButtonLongPressed);
+    m_buttons.append(button);
+}
+
+void Core::enableDBusInterface(QDBusConnection::BusType busType)
+{
+    m_dbusService = new NymeaNetworkManagerDBusService(busType, this);
 
-    // Start the bluetooth server for this wireless device
-    m_bluetoothServer->setAdvertiseName(m_advertiseName, m_forceFullName);
-    m_bluetoothServer->setModelName(m_platformName);
-    m_bluetoothServer->setSoftwareVersion(VERSION_STRING);
-    m_bluetoothServer->start();
+    // Deprecated
+    connect(m_dbusService, &NymeaNetworkManagerDBusService::enableBluetoothServerCalled, this,  &Core::onDBusStartRequested);
+
+    connect(m_dbusService, &NymeaNetworkManagerDBusService::startBluetoothServerRequested, this, &Core::onDBusStartRequested);
+    connect(m_dbusService, &NymeaNetworkManagerDBusService::stopBluetoothServerRequested, this, &Core::onDBusStopRequested);
 }
 
-void Core::stopService()
+void Core::enableStartupMeasurement(const QElapsedTimer &startupTimer, bool benchmark)
 {
-    if (m_bluetoothServer && m_bluetoothServer->running()) {
-        qCDebug(dcApplication()) << "Stopping bluetooth service";
-        m_bluetoothServer->stop();
+    m_measureStartup = true;
+    m_startupTimer = startupTimer;
+    m_benchmark = benchmark;
+
+    // The watchdog measures the stalls, with a short heartbeat only for the measurement
+    if (!LoopWatchdog::instance()->watching()) {
+        LoopWatchdog::instance()->startWatching(0, s_measurementHeartbeatInterval);
+        m_measurementWatchdog = true;
     }
 }
 
-void Core::onAdvertisingTimeout()
+void Core::enableMemoryReport()
 {
-    qCDebug(dcApplication()) << "Advertising timeout. Shutting down the bluetooth server.";
-    stopService();
+    m_reportMemory = true;
 }
 
-void Core::onDBusStartRequested()
+QVariantMap Core::memoryReport() const
 {
-    if (m_advertisingTimer->isActive()) {
-        qCDebug(dcApplication()) << "Start bluetooth server request received from DBus. Restart advertisement timer of" << m_advertisingTimeout << "seconds";
-        m_advertisingTimer->start(m_advertisingTimeout * 1000);
+    MemoryReport::Subsystems subsystems;
+    subsystems.append(qMakePair(QString("networkManager"), static_cast<const QObject *>(m_networkManager)));
+    if (m_networkManagerWatcher)
+        subsystems.append(qMakePair(QString("networkManager"), static_cast<const QObject *>(m_networkManagerWatcher)));
+    subsystems.append(qMakePair(QString("bluetoothServer"), static_cast<const QObject *>(m_bluetoothServer)));
+    subsystems.append(qMakePair(QString("nymeaService"), static_cast<const QObject *>(m_nymeaService)));
+    subsystems.append(qMakePair(QString("dbusService"), static_cast<const QObject *>(m_dbusService)));
+    foreach (GpioButton *button, m_buttons)
+        subsystems.append(qMakePair(QString("buttons"), static_cast<const QObject *>(button)));
+
+    if (m_gpioInputEngine)
+        subsystems.append(qMakePair(QString("buttons"), static_cast<const QObject *>(m_gpioInputEngine)));
+
+    return MemoryReport::collect(subsystems);
+}
+
+void Core::setConfigurationFile(const QString &fileName, const QVariantMap &overrides)
+{
+    m_configurationFileName = fileName;
+    m_configurationOverrides = overrides;
+
+    if (m_configurationFileName.isEmpty())
         return;
-    } else {
-        qCDebug(dcApplication()) << "Start bluetooth server request received from DBus. Starting advertisement timer of" << m_advertisingTimeout << "seconds";
-        m_advertisingTimer->start(m_advertisingTimeout * 1000);
-        startService();
-    }
+
+    m_configurationWatcher = new QFileSystemWatcher(QStringList() << m_configurationFileName, this);
+    connect(m_configurationWatcher, &QFileSystemWatcher::fileChanged, this, &Core::onConfigurationFileChanged);
 }
 
-void Core::onDBusStopRequested()
+bool Core::applyOverrides(const QVariantMap &overrides)
 {
-    m_advertisingTimer->stop();
-    stopService();
+    QVariantMap configurationOverrides = m_configurationOverrides;
+    foreach (const QString &key, overrides.keys()) {
+        configurationOverrides.insert(key, overrides.value(key));
+    }
+
+    // On top of the configuration in effect, file changes are only picked up by a reload
+    Configuration configuration;
+    if (!configuration.loadValues(m_configurationFileValues, configurationOverrides)) {
+        qCWarning(dcApplication()).noquote() << "Rejecting the configuration values" << overrides.keys().join(", ") << configuration.errorString();
+        return false;
+    }
+
+    qCDebug(dcApplication()) << "Applying the configuration values" << overrides;
+    m_configurationOverrides = configurationOverrides;
+    applyConfiguration(configuration);
+    return true;
 }
 
-void Core::onBluetoothServerRunningChanged(bool running)
+void Core::applyConfiguration(const Configuration &configuration)
 {
-    qCDebug(dcApplication()) << "Bluetooth server" << (running ? "started" : "stopped");
+    m_configurationFileValues = configuration.fileValues();
+    bool running = m_state != StateWaiting;
 
-    if (!running) {
-        m_advertisingTimer->stop();
+    bool advertisingChanged = configuration.advertiseName != m_advertiseName
+            || configuration.forceFullName != m_forceFullName
+            || configuration.platformName != m_platformName;
 
-        switch (m_mode) {
-        case ModeAlways:
-            qCDebug(dcApplication()) << "Restart the bluetooth service because of \"always\" mode.";
-            // Give some grace period for bluez to clean up and restart the service again
-            QTimer::singleShot(3000, this, &Core::startService);
-            break;
-        case ModeStart:
-            // Enable bluetooth on nymea
-            m_nymeaService->enableBluetooth(true);
-            // We are done here. The bluetooth server was already running
-            break;
-        case ModeOffline:
-            // Enable bluetooth on nymea
-            m_nymeaService->enableBluetooth(true);
-            evaluateNetworkManagerState(m_networkManager->state());
-            break;
-        case ModeOnce:
-            if (m_networkManager->networkSettings()->connections().isEmpty()) {
-                qCDebug(dcApplication()) << "Start the bluetooth service because of \"once\" mode and there is currenlty no network configured yet.";
-                startService();
+    setAdvertiseName(configuration.advertiseName, configuration.forceFullName);
+    setPlatformName(configuration.platformName);
+    setAdvertisingTimeout(configuration.timeout);
+    setTimeoutPolicy(configuration.timeoutPolicy);
+    setMaxSessions(configuration.maxSessions);
+    setStateDirectory(configuration.stateDirectory);
+    setScanMaxAge(configuration.scanMaxAge);
+    setNetworkManagerProfile(configuration.networkManagerProfile);
+    setOfflineDebounce(configuration.offlineDebounce);
+    m_nymeaService->setCallTimeout(configuration.nymeaCallTimeout);
+    setIdleExit(configuration.idleExit);
+    setDutyCycle(configuration.dutyCycleOn, configuration.dutyCycleOff);
+    setAdvertisingSchedule(configuration.scheduleStart, configuration.scheduleEnd);
+
+    bool buttonsChanged = false;
+    int buttonGpio = configuration.buttonGpio;
+#ifdef WITH_LAZY_SUBSYSTEMS
+    // The buttons are only needed in button mode
+    if (configuration.mode != ModeButton)
+        buttonGpio = -1;
+#endif
+
+    if (buttonGpio != m_buttonGpio || configuration.buttonActiveLow != m_buttonActiveLow || configuration.buttonChip != m_buttonChip
+            || configuration.buttonLongPress != m_buttonLongPress || configuration.buttonDebounce != m_buttonDebounce) {
+        qDeleteAll(m_buttons);
+        m_buttons.clear();
+        delete m_gpioInputEngine;
+        m_gpioInputEngine = nullptr;
+        m_buttonGpio = buttonGpio;
+        m_buttonActiveLow = configuration.buttonActiveLow;
+        m_buttonChip = configuration.buttonChip;
+        m_buttonLongPress = configuration.buttonLongPress;
+        m_buttonDebounce = configuration.buttonDebounce;
+        addGPioButton(m_buttonGpio, m_buttonActiveLow);
+        buttonsChanged = true;
+    }
+
+    if (configuration.dbusBusType != m_dbusBusType) {
+        if (m_dbusService) {
+            qCWarning(dcApplication()) << "Changing the DBus bus type to" << configuration.dbusBusType << "requires a restart of the daemon.";
+        } else {
+            m_dbusBusType = configuration.dbusBusType;
+            if (m_dbusBusType == "system") {
+                enableDBusInterface(QDBusConnection::SystemBus);
+            } else if (m_dbusBusType == "session") {
+                enableDBusInterface(QDBusConnection::SessionBus);
+            }
+        }
+    }
+
+    bool modeChanged = configuration.mode != m_mode;
+    if (modeChanged) {
+        qCDebug(dcApplication()) << "Changing mode from" << m_mode << "to" << configuration.mode;
+        setMode(configuration.mode);
+        if (running) {
+            m_offlineDebounceTimer->stop();
+            m_advertisingTimer->stop();
+            m_dutyCycleOffWindow = false;
+            if (m_state == StateFinished)
+                processEvent(EventReset);
+
+            if (m_mode == ModeButton || m_mode == ModeDBus) {
+                // These modes only advertise on request
+                if (m_state != StateConnected)
+                    stopService();
             } else {
-                // Enable bluetooth on nymea
-                m_nymeaService->enableBluetooth(true);
-                qCDebug(dcApplication()) << "Not starting the bluetooth service because of \"once\" mode. There are" << m_networkManager->networkSettings()->connections().count() << "network configurations.";
+                evaluateMode();
             }
-            break;
-        case ModeButton:
-        case ModeDBus:
-            break;
         }
     }
+
+    // The buttons are only armed in button mode
+    if (running && (buttonsChanged || modeChanged)) {
+        if (m_mode == ModeButton) {
+            enableButtons();
+        } else {
+            disableButtons();
+        }
+    }
+
+    // The advertising data can only be changed by restarting the server
+    if (advertisingChanged && (m_state == StateStarting || m_state == StateAdvertising)) {
+        qCDebug(dcApplication()) << "Advertising parameters changed. Restarting the bluetooth server.";
+        m_restartPending = true;
+        stopService();
+    }
+
+    if (running)
+        evaluateIdleExit();
 }
 
-void Core::onBluetoothServerConnectedChanged(bool connected)
+bool Core::reloadConfiguration()
 {
-    qCDebug(dcApplication()) << "Bluetooth client" << (connected ? "connected" : "disconnected");
-    m_advertisingTimer->stop();
+    WATCHDOG_SCOPE();
+    qCDebug(dcApplication()) << "Reloading configuration" << m_configurationFileName;
 
-    if (!connected && m_mode != ModeAlways) {
-        m_bluetoothServer->stop();
+    Configuration configuration;
+    if (!configuration.load(m_configurationFileName, m_configurationOverrides)) {
+        qCWarning(dcApplication()).noquote() << "Keeping the current configuration." << configuration.errorString();
+        return false;
     }
+
+    applyConfiguration(configuration);
+    return true;
 }
 
-void Core::onNetworkManagerAvailableChanged(bool available)
+void Core::run()
 {
-    if (!available) {
-        qCWarning(dcApplication()) << "Networkmanager is not available any more.";
-        return;
+    if (m_measureStartup) {
+        m_runTimestamp = m_startupTimer.elapsed();
+        qCDebug(dcApplication()) << "Startup measurement: main() to Core::run() took" << m_runTimestamp << "ms";
+
+        if (m_benchmark)
+            qCDebug(dcApplication()) << "Running startup benchmark in" << m_mode;
+
+        QTimer::singleShot(s_benchmarkTimeout, this, &Core::onBenchmarkTimeout);
     }
 
-    qCDebug(dcApplication()) << "Networkmanager is now available.";
+    // Decide from the snapshot before the networkmanager has been loaded, it gets validated once available
+    bool advertisingExpected = true;
+    if (m_mode == ModeOnce && m_networkSnapshot.valid() && m_networkSnapshot.connectionCount() > 0) {
+        qCDebug(dcApplication()) << "The network snapshot contains" << m_networkSnapshot.connectionCount() << "network configurations. Not preparing the bluetooth server in \"once\" mode.";
+        advertisingExpected = false;
+    }
 
-    switch (m_mode) {
-    case ModeAlways:
-        qCDebug(dcApplication()) << "Starting the Bluetooth service because of \"always\" mode.";
-        startService();
-        break;
-    case ModeStart:
-        // Only start it once in "start" mode...
-        static bool alreadyRan = false;
-        if (alreadyRan) {
-            return;
-        }
-        qCDebug(dcApplication()) << "Starting the Bluetooth service because of \"start\" mode.";
-        alreadyRan = true;
-        startService();
-        m_advertisingTimer->start(m_advertisingTimeout * 1000);
-        break;
-    case ModeOffline:
-        evaluateNetworkManagerState(m_networkManager->state());
-        break;
-    case ModeOnce:
-        if (m_networkManager->networkSettings()->connections().isEmpty()) {
-            qCDebug(dcApplication()) << "Starting the Bluetooth service because of \"once\" mode and there is currenlty no network configured yet.";
-            startService();
-        } else {
-            qCDebug(dcApplication()) << "Not starting the Bluetooth service because of \"once\" mode. There are" << m_networkManager->networkSettings()->connections().count() << "network configurations.";
-        }
-        break;
-    case ModeButton:
-        foreach (GpioButton* button, m_buttons) {
-            if (!button->enable()) {
-                qCCritical(dcApplication()) << "Failed to enable the GPIO button for" << button->gpioNumber();
-            }
-        }
-        break;
-    case ModeDBus:
-        break;
+#ifndef WITH_LAZY_SUBSYSTEMS
+    if (advertisingExpected && !m_bluetoothServer)
+        createBluetoothServer();
+#else
+    Q_UNUSED(advertisingExpected)
+#endif
+
+    // Start the networkmanager
+    m_metrics.begin(ProvisioningMetrics::PhaseNetworkManagerAvailable);
+    if (m_networkManagerProfile == NetworkManagerProfileWatch && (m_mode == ModeOffline || m_mode == ModeOnce)) {
+        // The object tree gets loaded once the bluetooth server is needed
+        qCDebug(dcApplication()) << "Watching the networkmanager state in" << m_mode << "mode";
+        m_networkManagerWatcher = new NetworkManagerWatcher(this);
+        connect(m_networkManagerWatcher, &NetworkManagerWatcher::availableChanged, this, &Core::onNetworkManagerWatcherAvailableChanged);
+        connect(m_networkManagerWatcher, &NetworkManagerWatcher::stateChanged, this, &Core::onNetworkManagerStateChanged);
+        m_networkManagerWatcher->start();
+    } else {
+        if (m_networkManagerProfile == NetworkManagerProfileWatch)
+            qCDebug(dcApplication()) << "The networkmanager can only be watched in offline and once mode. Loading the networkmanager in" << m_mode << "mode";
+
+        m_networkManager->start();
     }
-}
 
-void Core::onNetworkManagerStateChanged(NetworkManager::NetworkManagerState state)
-{
-    evaluateNetworkManagerState(state);
+    // Do not wait for the networkmanager, systemd would otherwise time out and restart the daemon while it is not running
+    notifyReady();
 }
 
-void Core::onNymeaServiceAvailableChanged(bool available)
+Core::RequestResult Core::requestStart(int timeout)
 {
-    if (available)
-        m_nymeaService->enableBluetooth(!m_bluetoothServer->running());
+    if (timeout != 0 && timeout < 10) {
+        qCWarning(dcApplication()) << "Start bluetooth server request received from DBus with an invalid timeout of" << timeout << "seconds.";
+        return RequestResultInvalid;
+    }
+
+    if (m_state == StateConnected) {
+        qCDebug(dcApplication()) << "Start bluetooth server request received from DBus but a client is already connected.";
+        return RequestResultBusy;
+    }
+
+    // The request which activated the daemon may arrive before the networkmanager is available
+    if (m_state == StateWaiting) {
+        qCDebug(dcApplication()) << "Start bluetooth server request received from DBus. Starting once the networkmanager is available.";
+        m_dbusStartPending = true;
+        m_dbusStartTimeout = timeout;
+        return RequestResultPending;
+    }
+
+    // While watching the networkmanager the wireless devices are not known yet
+    if (!m_networkManagerWatcher && !m_networkManager->wirelessAvailable()) {
+        qCWarning(dcApplication()) << "Start bluetooth server request received from DBus but there is no wireless device available.";
+        return RequestResultNotAvailable;
+    }
+
+    int window = timeout > 0 ? timeout * 1000 : advertisingWindow();
+    if (m_advertisingTimer->isActive() || m_state == StateStarting || m_state == StateAdvertising || (m_state == StateStopping && m_restartPending)) {
+        qCDebug(dcApplication()) << "Start bluetooth server request received from DBus. Restart advertisement timer of" << window / 1000 << "seconds";
+        m_advertisingTimer->start(window);
+        emit serverStateChanged();
+        return RequestResultMerged;
+    }
+
+    qCDebug(dcApplication()) << "Start bluetooth server request received from DBus. Starting advertisement timer of" << window / 1000 << "seconds";
+    m_advertisingTimer->start(window);
+    if (m_state == StateStopping) {
+        // Start again once the server has stopped
+        m_restartPending = true;
+    } else {
+        startService();
+    }
+
+    return RequestResultAccepted;
+}
+
+Core::RequestResult Core::requestStop()
+{
+    qCDebug(dcApplication()) << "Stop bluetooth server request received from DBus in" << m_state;
+
+    // The bluetooth server always gets started again in "always" mode
+    if (m_mode == ModeAlways && m_state == StateCoolingDown)
+        return RequestResultMerged;
+
+    bool active = (serverActive() && m_state != StateStopping) || m_startPending || m_dbusStartPending || m_restartPending;
+    m_dbusStartPending = false;
+    m_restartPending = false;
+    m_advertisingTimer->stop();
+    stopService();
+    return active ? RequestResultAccepted : RequestResultAlreadyStopped;
+}
+
+Core::Core(QObject *parent) :
+    QObject(parent)
+{
+    m_stateClock.start();
+
+    m_networkManager = new NetworkManager(this);
+    connect(m_networkManager, &NetworkManager::availableChanged, this, &Core::onNetworkManagerAvailableChanged);
+    connect(m_networkManager, &NetworkManager::stateChanged, this, &Core::onNetworkManagerStateChanged);
+
+    m_nymeaService = new NymeadService(false, this);
+    connect(m_nymeaService, &NymeadService::availableChanged, this, &Core::onNymeaServiceAvailableChanged);
+    connect(m_nymeaService, &NymeadService::enableBluetoothFinished, this, &Core::onNymeaBluetoothEnableFinished);
+
+    m_advertisingTimer = new QTimer(this);
+    m_advertisingTimer->setSingleShot(true);
+    connect(m_advertisingTimer, &QTimer::timeout, this, &Core::onAdvertisingTimeout);
+
+    m_restartTimer = new QTimer(this);
+    m_restartTimer->setSingleShot(true);
+    connect(m_restartTimer, &QTimer::timeout, this, &Core::onRestartTimeout);
+
+    m_offlineDebounceTimer = new QTimer(this);
+    m_offlineDebounceTimer->setSingleShot(true);
+    connect(m_offlineDebounceTimer, &QTimer::timeout, this, &Core::onOfflineDebounceTimeout);
+
+    m_idleExitTimer = new QTimer(this);
+    m_idleExitTimer->setSingleShot(true);
+    m_idleExitTimer->setInterval(s_idleExitDelay);
+    connect(m_idleExitTimer, &QTimer::timeout, this, &Core::onIdleExitTimeout);
+
+    // A coarse timer may fire early, the scan would be skipped for being too recent
+    m_scanTimer = new QTimer(this);
+    m_scanTimer->setTimerType(Qt::PreciseTimer);
+    connect(m_scanTimer, &QTimer::timeout, this, &Core::onScanTimeout);
+
+    // Editors write files in several steps, reload once they are done
+    m_configurationReloadTimer = new QTimer(this);
+    m_configurationReloadTimer->setSingleShot(true);
+    m_configurationReloadTimer->setInterval(500);
+    connect(m_configurationReloadTimer, &QTimer::timeout, this, &Core::reloadConfiguration);
+}
+
+Core::~Core()
+{
+    qCDebug(dcApplication()) << "Shutting down nymea service";
+    delete m_nymeaService;
+    m_nymeaService = nullptr;
+
+    qCDebug(dcApplication()) << "Shutting down bluetooth service";
+    delete m_bluetoothServer;
+    m_bluetoothServer = nullptr;
+
+    qCDebug(dcApplication()) << "Shutting down network-manager service";
+    delete m_networkManager;
+    m_networkManager = nullptr;
+}
+
+void Core::processEvent(Event event)
+{
+    for (const StateTransition &transition : s_stateTransitions) {
+        if (transition.from == m_state && transition.event == event) {
+            setState(transition.to, event);
+            return;
+        }
+    }
+
+    qCDebug(dcApplication()) << "Ignoring" << event << "in" << m_state;
+}
+
+void Core::setState(State state, Event event)
+{
+    qCDebug(dcApplication()) << "State transition" << m_state << "->" << state << "on" << event;
+
+    Transition transition;
+    transition.timestamp = m_stateClock.elapsed();
+    transition.from = m_state;
+    transition.to = state;
+    transition.event = event;
+    m_transitions.append(transition);
+    if (m_transitions.count() > s_transitionHistorySize)
+        m_transitions.removeFirst();
+
+    if (m_state == StateCoolingDown)
+        m_restartTimer->stop();
+
+    m_state = state;
+
+    // Note: the actions below can trigger further transitions
+    switch (m_state) {
+    case StateWaiting:
+        break;
+    case StateIdle:
+        if (event != EventServerStopped && event != EventStartFailed && event != EventStopRequested)
+            break;
+
+        // Restart with the new advertising parameters, a running advertising timer stays valid
+        if (m_restartPending && event == EventServerStopped) {
+            m_restartPending = false;
+            processEvent(EventRestartRequested);
+            break;
+        }
+
+        m_restartPending = false;
+        m_advertisingTimer->stop();
+
+        if (m_mode == ModeStart) {
+            // We are done here. The bluetooth server was already running
+            m_nymeaService->enableBluetooth(true);
+            processEvent(EventFinished);
+            break;
+        }
+
+        if (m_mode == ModeAlways && event == EventServerStopped) {
+            qCDebug(dcApplication()) << "Restart the bluetooth service because of \"always\" mode.";
+            processEvent(EventRestartRequested);
+            break;
+        }
+
+        // A failed start would fail again right away
+        if (event == EventServerStopped)
+            evaluateMode();
+
+        // Enable bluetooth on nymea if the server will not be started again
+        if (m_state == StateIdle)
+            m_nymeaService->enableBluetooth(true);
+
+        break;
+    case StateStarting:
+        m_sessionCount = 0;
+        m_prewarmed = false;
+        if (!startServer()) {
+            // Nothing will advertise, do not wait for the benchmark timeout
+            if (m_benchmark)
+                finishBenchmark(false);
+
+            processEvent(EventStartFailed);
+            break;
+        }
+
+        // The first client should get a fresh access point list right away
+        if (m_scanMaxAge > 0) {
+            refreshAccessPoints();
+            m_scanTimer->start(m_scanMaxAge * 1000);
+        }
+
+        break;
+    case StateAdvertising:
+        if (event == EventClientDisconnected && m_mode != ModeAlways) {
+            if (m_sessionCount >= m_maxSessions) {
+                processEvent(EventStopRequested);
+                break;
+            }
+
+            // The session may have brought the device online or configured a network
+            if (m_mode == ModeOffline) {
+                evaluateNetworkManagerState(networkManagerState());
+                if (m_state != StateAdvertising)
+                    break;
+            } else if (m_mode == ModeOnce && connectionCount() > 0) {
+                qCDebug(dcApplication()) << "A network has been configured. Not waiting for the next client because of \"once\" mode.";
+                processEvent(EventStopRequested);
+                break;
+            }
+
+            // Keep advertising for the next client in the queue
+            qCDebug(dcApplication()) << "Served" << m_sessionCount << "of" << m_maxSessions << "clients. Waiting for the next client.";
+            if (m_mode == ModeStart || m_mode == ModeButton || m_mode == ModeDBus)
+                m_advertisingTimer->start(advertisingWindow());
+        }
+
+        // Each advertising period gets the full on window
+        if (dutyCycled() && onWindow() > 0)
+            m_advertisingTimer->start(onWindow());
+
+        break;
+    case StateConnected:
+        m_advertisingTimer->stop();
+        break;
+    case StateStopping:
+        if (!m_restartPending)
+            m_advertisingTimer->stop();
+
+        stopServer();
+        break;
+    case StateCoolingDown:
+        // Give some grace period for bluez to clean up and restart the service again
+        if (m_dutyCycleOffWindow) {
+            m_dutyCycleOffWindow = false;
+            qCDebug(dcApplication()) << "Duty cycle: pausing the advertising for" << offWindow() / 1000 << "seconds";
+            m_restartTimer->start(offWindow());
+        } else {
+            m_restartTimer->start(s_restartGracePeriod);
+        }
+        break;
+    case StateFinished:
+        qCDebug(dcApplication()) << "The bluetooth server will not be started again in" << m_mode << "unless requested over DBus";
+        break;
+    }
+
+    evaluateIdleExit();
+}
+
+bool Core::advertisingPossible() const
+{
+    switch (m_state) {
+    case StateFinished:
+        return false;
+    case StateIdle:
+        // Once mode never advertises again as soon as a network has been configured
+        return m_mode != ModeOnce || connectionCount() == 0;
+    default:
+        return true;
+    }
+}
+
+bool Core::idleExitPossible() const
+{
+    // D-Bus activation starts the daemon again for the next request
+    if (m_mode == ModeDBus && m_state == StateIdle)
+        return !m_startPending && !m_dbusStartPending && !m_restartPending;
+
+    return !advertisingPossible();
+}
+
+void Core::evaluateIdleExit()
+{
+    if (!m_idleExit || !idleExitPossible()) {
+        if (m_idleExitTimer->isActive()) {
+            qCDebug(dcApplication()) << "Idle exit cancelled in" << m_state;
+            m_idleExitTimer->stop();
+        }
+        return;
+    }
+
+    if (!m_idleExitTimer->isActive()) {
+        if (m_mode == ModeDBus) {
+            qCDebug(dcApplication()) << "No DBus request pending. Exiting in" << s_idleExitDelay / 1000 << "seconds.";
+        } else {
+            qCDebug(dcApplication()) << "The bluetooth server will not be started again in" << m_mode << "mode. Exiting in" << s_idleExitDelay / 1000 << "seconds.";
+        }
+        m_idleExitTimer->start();
+    }
+}
+
+int Core::advertisingWindow() const
+{
+    if (m_timeoutPolicy == TimeoutPolicyAdaptive)
+        return m_adaptiveTimeout.timeout(m_advertisingTimeout) * 1000;
+
+    return m_advertisingTimeout * 1000;
+}
+
+void Core::updateWirelessDevice()
+{
+    // Like the bluetooth server of the networkmanager library, use the first wireless device
+    QList<WirelessNetworkDevice *> wirelessDevices = m_networkManager->wirelessNetworkDevices();
+    WirelessNetworkDevice *wirelessDevice = wirelessDevices.isEmpty() ? nullptr : wirelessDevices.first();
+    if (wirelessDevice == m_wirelessDevice)
+        return;
+
+    m_wirelessDevice = wirelessDevice;
+    if (m_wirelessDevice)
+        qCDebug(dcApplication()) << "Using wireless device" << m_wirelessDevice->interface();
+}
+
+void Core::refreshAccessPoints()
+{
+    if (!m_wirelessDevice)
+        return;
+
+    // The networkmanager keeps the access points, clients get them from there without waiting for a scan
+    if (m_lastScan.isValid() && m_lastScan.elapsed() < m_scanMaxAge * 1000)
+        return;
+
+    // Scanning while connecting would disturb the association
+    if (m_networkManager->state() == NetworkManager::NetworkManagerStateConnecting)
+        return;
+
+    qCDebug(dcApplication()) << "Refreshing the access points of" << m_wirelessDevice->interface();
+    m_wirelessDevice->scanWirelessNetworks();
+    m_lastScan.start();
+    m_metrics.increment(ProvisioningMetrics::CounterWirelessScans);
+}
+
+void Core::logBluetoothAdapters()
+{
+    QList<QBluetoothHostInfo> adapters = QBluetoothLocalDevice::allDevices();
+    foreach (const QBluetoothHostInfo &adapter, adapters) {
+        qCDebug(dcApplication()) << "Bluetooth adapter" << adapter.name() << adapter.address().toString();
+    }
+
+    // The bluetooth server always runs on the default controller
+    if (adapters.count() > 1)
+        qCDebug(dcApplication()) << "Found" << adapters.count() << "bluetooth adapters. The bluetooth server uses the default adapter" << QBluetoothLocalDevice().address().toString();
+}
+
+bool Core::timedWindow() const
+{
+    // Only these modes advertise for the advertising window, the connect latencies of the others would skew it
+    return m_mode == ModeStart || m_mode == ModeButton || m_mode == ModeDBus;
+}
+
+bool Core::dutyCycled() const
+{
+    return m_mode == ModeAlways && (m_dutyCycleOn > 0 || m_scheduleStart.isValid());
+}
+
+bool Core::withinSchedule() const
+{
+    if (!m_scheduleStart.isValid() || m_scheduleStart == m_scheduleEnd)
+        return true;
+
+    QTime now = QTime::currentTime();
+    if (m_scheduleStart < m_scheduleEnd)
+        return now >= m_scheduleStart && now < m_scheduleEnd;
+
+    // The schedule spans midnight
+    return now >= m_scheduleStart || now < m_scheduleEnd;
+}
+
+int Core::onWindow() const
+{
+    int window = m_dutyCycleOn * 1000;
+    if (m_scheduleStart.isValid() && m_scheduleStart != m_scheduleEnd) {
+        int untilEnd = QTime::currentTime().msecsTo(m_scheduleEnd);
+        if (untilEnd <= 0)
+            untilEnd += 24 * 60 * 60 * 1000;
+
+        window = window > 0 ? qMin(window, untilEnd) : untilEnd;
+    }
+
+    return window;
+}
+
+int Core::offWindow() const
+{
+    int window = m_dutyCycleOn > 0 ? m_dutyCycleOff * 1000 : 0;
+    if (!withinSchedule()) {
+        int untilStart = QTime::currentTime().msecsTo(m_scheduleStart);
+        if (untilStart < 0)
+            untilStart += 24 * 60 * 60 * 1000;
+
+        window = qMax(window, untilStart);
+    }
+
+    return qMax(window, s_restartGracePeriod);
+}
+
+bool Core::serverActive() const
+{
+    switch (m_state) {
+    case StateStarting:
+    case StateAdvertising:
+    case StateConnected:
+    case StateStopping:
+    case StateCoolingDown:
+        return true;
+    default:
+        return false;
+    }
+}
+
+void Core::notifyReady()
+{
+    if (m_readyNotified)
+        return;
+
+    m_readyNotified = true;
+    qCDebug(dcApplication()) << "Ready";
+    if (m_reportMemory)
+        logMemoryReport();
+
+    // Tell systemd the startup has finished, the daemon follows the networkmanager from now on
+    sd_notify(0, "READY=1");
+}
+
+bool Core::networkManagerAvailable() const
+{
+    if (m_networkManagerWatcher)
+        return m_networkManagerWatcher->available();
+
+    return m_networkManager->available();
+}
+
+NetworkManager::NetworkManagerState Core::networkManagerState() const
+{
+    if (m_networkManagerWatcher)
+        return m_networkManagerWatcher->state();
+
+    return m_networkManager->state();
+}
+
+int Core::connectionCount() const
+{
+    if (m_networkManagerWatcher)
+        return m_networkManagerWatcher->connectionCount();
+
+    return m_networkManager->networkSettings()->connections().count();
+}
+
+void Core::loadNetworkManager()
+{
+    if (!m_networkManagerWatcher || m_networkManagerLoading)
+        return;
+
+    qCDebug(dcApplication()) << "Loading the networkmanager for the bluetooth server";
+    m_networkManagerLoading = true;
+    m_metrics.begin(ProvisioningMetrics::PhaseNetworkManagerLoad);
+    m_networkManager->start();
+}
+
+void Core::replaceNetworkManagerWatcher()
+{
+    qCDebug(dcApplication()) << "Networkmanager loaded. Not watching the networkmanager state any more.";
+    m_metrics.end(ProvisioningMetrics::PhaseNetworkManagerLoad);
+    m_networkManagerLoading = false;
+    delete m_networkManagerWatcher;
+    m_networkManagerWatcher = nullptr;
+
+    // The networkmanager disappeared and came back while loading
+    if (m_state == StateWaiting) {
+        m_startPending = false;
+        evaluateNetworkManagerAvailable(true);
+        return;
+    }
+
+    updateWirelessDevice();
+    if (m_startPending) {
+        m_startPending = false;
+        startService();
+    }
+
+    // The wireless device mode is only known from now on. A state which is still settling is decided by the debounce timeout.
+    if (m_mode == ModeOffline && !m_offlineDebounceTimer->isActive())
+        evaluateNetworkManagerState(m_networkManager->state());
+}
+
+void Core::evaluateMode()
+{
+    switch (m_mode) {
+    case ModeAlways:
+        if (m_state == StateIdle && dutyCycled() && !withinSchedule()) {
+            qCDebug(dcApplication()) << "Not starting the Bluetooth service in \"always\" mode outside of the advertising schedule.";
+            m_dutyCycleOffWindow = true;
+            processEvent(EventRestartRequested);
+            break;
+        }
+
+        qCDebug(dcApplication()) << "Starting the Bluetooth service because of \"always\" mode.";
+        startService();
+        break;
+    case ModeStart:
+        // Switched to "start" mode while advertising, the window starts now
+        if ((m_state == StateStarting || m_state == StateAdvertising) && !m_advertisingTimer->isActive()) {
+            qCDebug(dcApplication()) << "Starting advertisement timer of" << advertisingWindow() / 1000 << "seconds because of \"start\" mode.";
+            m_advertisingTimer->start(advertisingWindow());
+            return;
+        }
+
+        if (m_state != StateIdle)
+            return;
+
+        qCDebug(dcApplication()) << "Starting the Bluetooth service because of \"start\" mode.";
+        m_advertisingTimer->start(advertisingWindow());
+        startService();
+        break;
+    case ModeOffline:
+        evaluateNetworkManagerState(networkManagerState());
+        break;
+    case ModeOnce: {
+        int connections = connectionCount();
+        if (m_networkSnapshot.valid() && m_networkSnapshot.connectionCount() != connections)
+            qCDebug(dcApplication()) << "The network snapshot was outdated, there are" << connections << "instead of" << m_networkSnapshot.connectionCount() << "network configurations.";
+
+        m_networkSnapshot.setConnectionCount(connections);
+        if (connections == 0) {
+            qCDebug(dcApplication()) << "Starting the Bluetooth service because of \"once\" mode and there is currenlty no network configured yet.";
+            startService();
+        } else {
+            qCDebug(dcApplication()) << "Not starting the Bluetooth service because of \"once\" mode. There are" << connections << "network configurations.";
+            // I.e. switched to "once" mode while advertising
+            if (m_state == StateStarting || m_state == StateAdvertising)
+                stopService();
+        }
+        break;
+    }
+    case ModeButton:
+    case ModeDBus:
+        break;
+    }
+}
+
+void Core::evaluateNetworkManagerState(NetworkManager::NetworkManagerState state)
+{
+    if (m_mode != ModeOffline)
+        return;
+
+    // Note: if the wireless device is in the access point mode, the bluetooth server should stop
+    if (m_wirelessDevice && m_wirelessDevice->wirelessMode() == WirelessNetworkDevice::WirelessModeAccessPoint) {
+        stopService();
+        return;
+    }
+
+    switch (state) {
+    case NetworkManager::NetworkManagerStateConnectedGlobal:
+        // We are online
+        qCDebug(dcApplication()) << "Not advertising bluetooth because we are online and we are running in" << m_mode;
+        if (m_state != StateConnected && serverActive()) {
+            qCDebug(dcApplication()) << "Stop the bluetooth service because of \"offline\" mode.";
+            stopService();
+        }
+        break;
+    case NetworkManager::NetworkManagerStateConnectedSite:
+        // We are somehow in the network
+        if (m_state != StateConnected && serverActive()) {
+            qCDebug(dcApplication()) << "Stop the bluetooth service because of \"offline\" mode.";
+            stopService();
+        }
+        break;
+    case NetworkManager::NetworkManagerStateUnknown:
+    case NetworkManager::NetworkManagerStateAsleep:
+    case NetworkManager::NetworkManagerStateDisconnected:
+    case NetworkManager::NetworkManagerStateConnectedLocal:
+        if (networkManagerAvailable()) {
+            // Everything else is not connected, start the service
+            if (!serverActive()) {
+                qCDebug(dcApplication()) << "Start the bluetooth service because of \"offline\" mode.";
+                startService();
+            }
+        } else {
+            qCDebug(dcApplication()) << "Not starting the service yet because the networkmanager is not available.";
+        }
+        break;
+    default:
+        qCDebug(dcApplication()) << "Ignoring" << state;
+        break;
+    }
+}
+
+bool Core::startServer()
+{
+    if (!m_networkManager->available()) {
+        qCWarning(dcApplication()) << "Could not start services. There is no network manager available.";
+        return false;
+    }
+
+    // Verify if we have a wireless network available
+    if (!m_networkManager->wirelessAvailable()) {
+        qCWarning(dcApplication()) << "Could not start services. There is no wireless device available.";
+        return false;
+    }
+
+    updateWirelessDevice();
+    if (!m_wirelessDevice) {
+        qCWarning(dcApplication()) << "Could not start services. The wireless device is not available.";
+        return false;
+    }
+
+    m_metrics.begin(ProvisioningMetrics::PhaseBluetoothServerStart);
+
+    // Disable bluetooth on nymea in order to not crash with client connections,
+    // the server gets started once nymea released the adapter or the call failed
+    if (m_nymeaService->available()) {
+        m_waitingForNymea = true;
+        m_nymeaService->enableBluetooth(false);
+        return true;
+    }
+
+    launchBluetoothServer();
+    return true;
+}
+
+void Core::launchBluetoothServer()
+{
+    m_waitingForNymea = false;
+    switch (m_state) {
+    case StateStarting:
+        // Start the bluetooth server for this wireless device
+        prepareBluetoothServer();
+        m_bluetoothServer->start();
+        break;
+    case StateStopping:
+        // Stopped before it was started
+        m_metrics.cancel(ProvisioningMetrics::PhaseBluetoothServerStart);
+        processEvent(EventServerStopped);
+        emit serverStateChanged();
+        break;
+    default:
+        break;
+    }
+}
+
+void Core::enableButtons()
+{
+    foreach (GpioButton* button, m_buttons) {
+        if (!button->enable()) {
+            qCCritical(dcApplication()) << "Failed to enable the GPIO button for" << button->gpioNumber();
+        }
+    }
+
+    if (m_gpioInputEngine && !m_gpioInputEngine->enable()) {
+        qCCritical(dcApplication()) << "Failed to enable the GPIO buttons" << m_gpioInputEngine->offsets() << "of" << m_gpioInputEngine->chip();
+    }
+}
+
+void Core::disableButtons()
+{
+    foreach (GpioButton* button, m_buttons) {
+        button->disable();
+    }
+
+    if (m_gpioInputEngine)
+        m_gpioInputEngine->disable();
+}
+
+void Core::createBluetoothServer()
+{
+    m_bluetoothServer = new BluetoothServer(m_networkManager);
+
+    connect(m_bluetoothServer, &BluetoothServer::runningChanged, this, &Core::onBluetoothServerRunningChanged, Qt::QueuedConnection);
+    connect(m_bluetoothServer, &BluetoothServer::connectedChanged, this, &Core::onBluetoothServerConnectedChanged, Qt::QueuedConnection);
+}
+
+void Core::prepareBluetoothServer()
+{
+    // Created on the first start if the build creates the subsystems only when they are needed
+    if (!m_bluetoothServer)
+        createBluetoothServer();
+
+    m_bluetoothServer->setAdvertiseName(m_advertiseName, m_forceFullName);
+    m_bluetoothServer->setModelName(m_platformName);
+    m_bluetoothServer->setSoftwareVersion(VERSION_STRING);
+}
+
+void Core::prewarm()
+{
+    if (m_prewarmed || serverActive())
+        return;
+
+    // Do the work which does not depend on the decision while the networkmanager state settles.
+    // Bluetooth stays with nymea until the server really starts, the state may still recover.
+    qCDebug(dcApplication()) << "Preparing the bluetooth server within the offline debounce window";
+    m_prewarmed = true;
+    m_metrics.increment(ProvisioningMetrics::CounterPrewarms);
+
+    prepareBluetoothServer();
+    loadNetworkManager();
+    updateWirelessDevice();
+
+    // Background scans are disabled without ScanMaxAge
+    if (m_scanMaxAge > 0)
+        refreshAccessPoints();
+}
+
+void Core::logMemoryReport()
+{
+    QByteArray report = QJsonDocument::fromVariant(memoryReport()).toJson(QJsonDocument::Compact);
+    qCDebug(dcApplication()).noquote() << "Memory report:" << report;
+}
+
+void Core::stopServer()
+{
+    // If the server is still starting up, it gets stopped once it is running
+    if (m_bluetoothServer && m_bluetoothServer->running()) {
+        qCDebug(dcApplication()) << "Stopping bluetooth service";
+        m_metrics.begin(ProvisioningMetrics::PhaseBluetoothServerStop);
+        m_bluetoothServer->stop();
+    }
+}
+
+void Core::startService()
+{
+    WATCHDOG_SCOPE();
+    // The bluetooth server needs the whole networkmanager, start once it has been loaded
+    if (m_networkManagerWatcher && m_state != StateWaiting) {
+        m_startPending = true;
+        loadNetworkManager();
+        return;
+    }
+
+    processEvent(EventStartRequested);
+}
+
+void Core::stopService()
+{
+    WATCHDOG_SCOPE();
+    // A stop restarts the server in "always" mode, keep the scheduled restart instead of idling forever
+    if (m_mode == ModeAlways && m_state == StateCoolingDown) {
+        qCDebug(dcApplication()) << "Keeping the scheduled restart of the bluetooth server in \"always\" mode.";
+        return;
+    }
+
+    m_startPending = false;
+    processEvent(EventStopRequested);
+}
+
+void Core::onAdvertisingTimeout()
+{
+    WATCHDOG_SCOPE();
+    if (dutyCycled()) {
+        qCDebug(dcApplication()) << "Duty cycle: advertising window elapsed. Shutting down the bluetooth server.";
+        m_dutyCycleOffWindow = true;
+    } else {
+        qCDebug(dcApplication()) << "Advertising timeout. Shutting down the bluetooth server.";
+        // No client within the window, a real latency sample would not exist
+        if (timedWindow() && m_state == StateAdvertising)
+            m_adaptiveTimeout.recordExpired();
+    }
+    stopService();
+}
+
+void Core::onRestartTimeout()
+{
+    WATCHDOG_SCOPE();
+    processEvent(EventCooldownElapsed);
+}
+
+void Core::onIdleExitTimeout()
+{
+    WATCHDOG_SCOPE();
+    if (!m_idleExit || !idleExitPossible())
+        return;
+
+    // Core gets destroyed after the event loop returned, which hands bluetooth back to nymea
+    qCDebug(dcApplication()) << "Nothing left to do. Exiting.";
+    QCoreApplication::quit();
+}
+
+void Core::onScanTimeout()
+{
+    WATCHDOG_SCOPE();
+    if (!serverActive() || m_state == StateStopping) {
+        m_scanTimer->stop();
+        return;
+    }
+
+    refreshAccessPoints();
+}
+
+void Core::onOfflineDebounceTimeout()
+{
+    WATCHDOG_SCOPE();
+    NetworkManager::NetworkManagerState state = networkManagerState();
+    qCDebug(dcApplication()) << "Networkmanager state settled to" << state;
+    evaluateNetworkManagerState(state);
+}
+
+void Core::onConfigurationFileChanged(const QString &fileName)
+{
+    WATCHDOG_SCOPE();
+    // Files replaced by a rename are dropped from the watcher
+    if (!m_configurationWatcher->files().contains(fileName) && QFileInfo::exists(fileName))
+        m_configurationWatcher->addPath(fileName);
+
+    m_configurationReloadTimer->start();
+}
+
+void Core::finishStartupMeasurement()
+{
+    m_measureStartup = false;
+    m_maxStall = LoopWatchdog::instance()->maxStall();
+    if (m_measurementWatchdog) {
+        m_measurementWatchdog = false;
+        LoopWatchdog::instance()->stopWatching();
+    }
+}
+
+void Core::onBenchmarkTimeout()
+{
+    if (m_benchmark) {
+        qCWarning(dcApplication()) << "Startup benchmark timeout. The bluetooth server did not advertise and stop within" << s_benchmarkTimeout / 1000 << "seconds.";
+        finishBenchmark(false);
+        return;
+    }
+
+    if (m_measureStartup && !m_firstAdvertisementMeasured) {
+        qCWarning(dcApplication()) << "Startup measurement: the bluetooth server did not advertise within" << s_benchmarkTimeout / 1000 << "seconds.";
+        finishStartupMeasurement();
+    }
+}
+
+void Core::finishBenchmark(bool success)
+{
+    if (!m_benchmark)
+        return;
+
+    m_benchmark = false;
+    if (m_measureStartup)
+        finishStartupMeasurement();
+
+    // One machine readable line on stdout, times in ms, -1 if not reached
+    QVariantMap result;
+    result.insert("mode", QMetaEnum::fromType<Mode>().valueToKey(m_mode));
+    result.insert("success", success);
+    result.insert("timeToRun", m_runTimestamp);
+    result.insert("timeToAdvertise", m_advertiseTimestamp < 0 ? -1 : m_advertiseTimestamp - m_runTimestamp);
+    result.insert("timeToStop", success ? m_stopTimestamp : -1);
+    result.insert("maxStall", m_maxStall);
+    result.insert("metrics", m_metrics.toVariantMap());
+    QByteArray json = QJsonDocument::fromVariant(result).toJson(QJsonDocument::Compact);
+    fprintf(stdout, "%s\n", json.constData());
+    fflush(stdout);
+
+    QCoreApplication::exit(success ? 0 : 1);
+}
+
+void Core::onButtonLongPressed()
+{
+    WATCHDOG_SCOPE();
+    if (m_mode != ModeButton) {
+        qCDebug(dcApplication()) << "Button pressed but not running in" << ModeButton;
+        return;
+    }
+
+    if (m_state == StateConnected) {
+        qCDebug(dcApplication()) << "Button pressed but a client is already connected.";
+        return;
+    }
+
+    qCDebug(dcApplication()) << "Button pressed. Starting advertisement timer of" << advertisingWindow() / 1000 << "seconds";
+    m_advertisingTimer->start(advertisingWindow());
+    startService();
+}
+
+void Core::onDBusStartRequested()
+{
+    WATCHDOG_SCOPE();
+    requestStart();
+}
+
+void Core::onDBusStopRequested()
+{
+    WATCHDOG_SCOPE();
+    requestStop();
+}
+
+void Core::onBluetoothServerRunningChanged(bool running)
+{
+    WATCHDOG_SCOPE();
+    qCDebug(dcApplication()) << "Bluetooth server" << (running ? "started" : "stopped");
+
+    bool benchmarkStop = false;
+    if (running && m_measureStartup && !m_firstAdvertisementMeasured) {
+        m_firstAdvertisementMeasured = true;
+        m_advertiseTimestamp = m_startupTimer.elapsed();
+        qCDebug(dcApplication()) << "Startup measurement: Core::run() to first bluetooth advertisement took" << m_advertiseTimestamp - m_runTimestamp << "ms";
+        qCDebug(dcApplication()) << "Startup measurement: the event loop was blocked for up to" << LoopWatchdog::instance()->maxStall() << "ms";
+        if (m_benchmark) {
+            benchmarkStop = true;
+        } else {
+            finishStartupMeasurement();
+        }
+    }
+
+    if (!running && m_benchmark) {
+        if (m_stopTimestamp >= 0) {
+            m_stopTimestamp = m_startupTimer.elapsed() - m_stopTimestamp;
+            finishBenchmark(true);
+        } else if (!m_firstAdvertisementMeasured) {
+            // The server failed before advertising
+            finishBenchmark(false);
+        }
+    }
+
+    if (running) {
+        m_metrics.end(ProvisioningMetrics::PhaseBluetoothServerStart);
+        m_metrics.begin(ProvisioningMetrics::PhaseClientConnect);
+
+        // Listing the adapters is a blocking call to BlueZ, only done for the debug output once the server is up
+        if (!m_bluetoothAdaptersLogged && dcApplication().isDebugEnabled()) {
+            m_bluetoothAdaptersLogged = true;
+            logBluetoothAdapters();
+        }
+    } else {
+        m_metrics.cancel(ProvisioningMetrics::PhaseBluetoothServerStart);
+        m_metrics.cancel(ProvisioningMetrics::PhaseClientConnect);
+        m_metrics.cancel(ProvisioningMetrics::PhaseWirelessConnect);
+        m_metrics.end(ProvisioningMetrics::PhaseBluetoothServerStop);
+        if (m_reportMemory)
+            logMemoryReport();
+    }
+
+    processEvent(running ? EventServerStarted : EventServerStopped);
+    emit serverStateChanged();
+
+    if (benchmarkStop) {
+        m_stopTimestamp = m_startupTimer.elapsed();
+        stopService();
+    }
+}
+
+void Core::onBluetoothServerConnectedChanged(bool connected)
+{
+    WATCHDOG_SCOPE();
+    qCDebug(dcApplication()) << "Bluetooth client" << (connected ? "connected" : "disconnected");
+
+    if (connected) {
+        qint64 connectLatency = m_metrics.end(ProvisioningMetrics::PhaseClientConnect);
+        if (connectLatency >= 0 && timedWindow() && m_advertisingTimer->isActive())
+            m_adaptiveTimeout.record(connectLatency);
+        m_metrics.begin(ProvisioningMetrics::PhaseWirelessConnect);
+
+        Session session;
+        session.started = m_stateClock.elapsed();
+        session.duration = -1;
+        session.online = false;
+        m_sessions.append(session);
+        if (m_sessions.count() > s_sessionHistorySize)
+            m_sessions.removeFirst();
+
+        m_sessionActive = true;
+        m_sessionCount++;
+    } else if (m_sessionActive) {
+        m_sessionActive = false;
+        m_sessions.last().duration = m_stateClock.elapsed() - m_sessions.last().started;
+        // A later connection does not belong to this session any more
+        m_metrics.cancel(ProvisioningMetrics::PhaseWirelessConnect);
+        m_metrics.begin(ProvisioningMetrics::PhaseClientConnect);
+    }
+
+    processEvent(connected ? EventClientConnected : EventClientDisconnected);
+    emit serverStateChanged();
+}
+
+void Core::onNetworkManagerAvailableChanged(bool available)
+{
+    WATCHDOG_SCOPE();
+    // Loaded on demand while watching, from now on the networkmanager replaces the watcher
+    if (m_networkManagerWatcher) {
+        if (available)
+            replaceNetworkManagerWatcher();
+
+        return;
+    }
+
+    evaluateNetworkManagerAvailable(available);
+}
+
+void Core::evaluateNetworkManagerAvailable(bool available)
+{
+    if (!available) {
+        qCWarning(dcApplication()) << "Networkmanager is not available any more.";
+        m_networkManagerStateReported = false;
+        m_metrics.begin(ProvisioningMetrics::PhaseNetworkManagerAvailable);
+        processEvent(EventNetworkManagerUnavailable);
+        emit networkManagerStateChanged(networkManagerState());
+        return;
+    }
+
+    qCDebug(dcApplication()) << "Networkmanager is now available.";
+    m_metrics.end(ProvisioningMetrics::PhaseNetworkManagerAvailable);
+    if (m_networkManager->available())
+        updateWirelessDevice();
+
+    processEvent(EventNetworkManagerAvailable);
+    emit networkManagerStateChanged(networkManagerState());
+
+    if (m_mode == ModeButton)
+        enableButtons();
+
+    evaluateMode();
+
+    if (m_dbusStartPending) {
+        m_dbusStartPending = false;
+        requestStart(m_dbusStartTimeout);
+    }
+}
+
+void Core::onNetworkManagerStateChanged(NetworkManager::NetworkManagerState state)
+{
+    WATCHDOG_SCOPE();
+    // While the networkmanager gets loaded, the watcher and the networkmanager both report each transition
+    if (m_networkManagerStateReported && state == m_networkManagerState)
+        return;
+
+    m_networkManagerStateReported = true;
+    m_networkManagerState = state;
+    emit networkManagerStateChanged(state);
+    if (state == NetworkManager::NetworkManagerStateConnectedGlobal) {
+        m_metrics.end(ProvisioningMetrics::PhaseWirelessConnect);
+        if (m_sessionActive) {
+            m_sessions.last().online = true;
+            WirelessAccessPoint *accessPoint = m_wirelessDevice ? m_wirelessDevice->activeAccessPoint() : nullptr;
+            m_networkSnapshot.setProvisioned(accessPoint ? accessPoint->ssid() : QString());
+        }
+    }
+
+    if (m_mode != ModeOffline)
+        return;
+
+    if (m_offlineDebounce <= 0) {
+        evaluateNetworkManagerState(state);
+        return;
+    }
+
+    // Only act once the state did not change for the debounce window, i.e. while DHCP renegotiates
+    if (m_offlineDebounceTimer->isActive()) {
+        qCDebug(dcApplication()) << "Networkmanager state changed to" << state << "within the debounce window. Coalescing state changes.";
+        m_metrics.increment(ProvisioningMetrics::CounterSuppressedStateChanges);
+    }
+
+    m_offlineDebounceTimer->start(m_offlineDebounce);
+
+    // Make the start cheap in case the state settles offline
+    switch (state) {
+    case NetworkManager::NetworkManagerStateUnknown:
+    case NetworkManager::NetworkManagerStateAsleep:
+    case NetworkManager::NetworkManagerStateDisconnected:
+    case NetworkManager::NetworkManagerStateConnectedLocal:
+        prewarm();
+        break;
+    case NetworkManager::NetworkManagerStateConnectedSite:
+    case NetworkManager::NetworkManagerStateConnectedGlobal:
+        m_prewarmed = false;
+        break;
+    default:
+        break;
+    }
+}
+
+void Core::onNetworkManagerWatcherAvailableChanged(bool available)
+{
+    WATCHDOG_SCOPE();
+    evaluateNetworkManagerAvailable(available);
+}
+
+void Core::onNymeaServiceAvailableChanged(bool available)
+{
+    WATCHDOG_SCOPE();
+    if (available) {
+        m_nymeaService->enableBluetooth(!serverActive());
+        return;
+    }
+
+    // There is no reply to wait for any more
+    if (m_waitingForNymea)
+        launchBluetoothServer();
+}
+
+void Core::onNymeaBluetoothEnableFinished(bool enable, bool success)
+{
+    WATCHDOG_SCOPE();
+    if (!enable && m_waitingForNymea) {
+        if (!success)
+            qCWarning(dcApplication()) << "Could not disable bluetooth on nymea. Starting the bluetooth server anyways, clients may fail to connect while nymea is using the bluetooth adapter.";
+
+        launchBluetoothServer();
+        return;
+    }
+
+    if (success)
+        return;
+
+    // The request is not repeated, nymea gets the adapter back with the next server stop
+    if (!enable && serverActive()) {
+        qCWarning(dcApplication()) << "Could not disable bluetooth on nymea. Clients may fail to connect while nymea is using the bluetooth adapter.";
+    } else if (enable && !serverActive()) {
+        qCWarning(dcApplication()) << "Could not give the bluetooth adapter back to nymea.";
+    }
 }
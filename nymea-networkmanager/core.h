@@ -26,8 +26,18 @@
 #define CORE_H
 
 #include <QObject>
+#include <QPointer>
+#include <QVariant>
+#include <QFileSystemWatcher>
+#include <QElapsedTimer>
+#include <QTime>
 
 #include "nymeadservice.h"
+#include "provisioningmetrics.h"
+#include "adaptivetimeout.h"
+#include "networksnapshot.h"
+#include "networkmanagerwatcher.h"
+#include "gpioinputengine.h"
 #include <gpiobutton.h>
 #include <bluetooth/bluetoothserver.h>
 #include <networkmanager.h>
@@ -35,6 +45,9 @@
 
 Q_DECLARE_LOGGING_CATEGORY(dcApplication)
 
+class Configuration;
+class NymeaNetworkManagerDBusService;
+
 class Core : public QObject
 {
     Q_OBJECT
@@ -52,13 +65,74 @@ public:
     };
     Q_ENUM(Mode)
 
+    enum State {
+        StateWaiting,       // The networkmanager is not available
+        StateIdle,          // The bluetooth server is stopped and could be started
+        StateStarting,      // The bluetooth server has been started and is not running yet
+        StateAdvertising,   // The bluetooth server is running and waits for a client
+        StateConnected,     // A client is connected to the bluetooth server
+        StateStopping,      // The bluetooth server has been stopped and is still running
+        StateCoolingDown,   // Grace period for bluez before restarting the bluetooth server
+        StateFinished       // The bluetooth server will not be started again
+    };
+    Q_ENUM(State)
+
+    enum Event {
+        EventNetworkManagerAvailable,
+        EventNetworkManagerUnavailable,
+        EventStartRequested,
+        EventStartFailed,
+        EventStopRequested,
+        EventRestartRequested,
+        EventCooldownElapsed,
+        EventServerStarted,
+        EventServerStopped,
+        EventClientConnected,
+        EventClientDisconnected,
+        EventFinished,
+        EventReset
+    };
+    Q_ENUM(Event)
+
+    enum TimeoutPolicy {
+        TimeoutPolicyFixed,
+        TimeoutPolicyAdaptive
+    };
+    Q_ENUM(TimeoutPolicy)
+
+    enum RequestResult {
+        RequestResultAccepted,          // The bluetooth server gets started or stopped
+        RequestResultMerged,            // The server was already started, a running advertising timer has been restarted
+        RequestResultPending,           // Executed once the networkmanager is available
+        RequestResultBusy,              // A client is connected
+        RequestResultNotAvailable,      // There is no wireless device
+        RequestResultAlreadyStopped,    // There is no bluetooth server to stop
+        RequestResultInvalid            // Invalid arguments
+    };
+    Q_ENUM(RequestResult)
+
+    enum NetworkManagerProfile {
+        NetworkManagerProfileFull,
+        NetworkManagerProfileWatch
+    };
+    Q_ENUM(NetworkManagerProfile)
+
     NetworkManager *networkManager() const;
     BluetoothServer *bluetoothServer() const;
     NymeadService *nymeaService() const;
+    const ProvisioningMetrics &metrics() const;
 
     Mode mode() const;
     void setMode(Mode mode);
 
+    State state() const;
+    NetworkManager::NetworkManagerState networkManagerState() const;
+
+    // In seconds, -1 if the advertising is not limited
+    int remainingAdvertisingTime() const;
+    QVariantList transitionHistory() const;
+    QVariantList sessionHistory() const;
+
     QString advertiseName() const;
     void setAdvertiseName(const QString &name, bool forceFullName = false);
 
@@ -68,33 +142,218 @@ public:
     int advertisingTimeout() const;
     void setAdvertisingTimeout(int advertisingTimeout);
 
+    // The number of clients served one after another before the server stops
+    int maxSessions() const;
+    void setMaxSessions(int maxSessions);
+
+    TimeoutPolicy timeoutPolicy() const;
+    void setTimeoutPolicy(TimeoutPolicy timeoutPolicy);
+    const AdaptiveTimeout &adaptiveTimeout() const;
+
+    // Refresh the access points in the background while the server is active, 0 to disable
+    int scanMaxAge() const;
+    void setScanMaxAge(int scanMaxAge);
+
+    // Watch only the networkmanager state in offline and once mode, read on start
+    NetworkManagerProfile networkManagerProfile() const;
+    void setNetworkManagerProfile(NetworkManagerProfile networkManagerProfile);
+
+    QString stateDirectory() const;
+    void setStateDirectory(const QString &stateDirectory);
+
+    int offlineDebounce() const;
+    void setOfflineDebounce(int offlineDebounce);
+
+    bool idleExit() const;
+    void setIdleExit(bool idleExit);
+
+    // Duty cycled advertising in always mode, 0 seconds on means continuous advertising
+    int dutyCycleOn() const;
+    int dutyCycleOff() const;
+    void setDutyCycle(int onSeconds, int offSeconds);
+
+    // Advertise in always mode only within this time of day, invalid times for no schedule
+    void setAdvertisingSchedule(const QTime &start, const QTime &end);
+
     void addGPioButton(int buttonGpio, bool activeLow = false);
     void enableDBusInterface(QDBusConnection::BusType busType);
+    void enableStartupMeasurement(const QElapsedTimer &startupTimer, bool benchmark = false);
+    void enableMemoryReport();
+
+    QVariantMap memoryReport() const;
+
+    void setConfigurationFile(const QString &fileName, const QVariantMap &overrides);
+    // Replace configuration values at runtime, they are kept on reloading like the command line values
+    bool applyOverrides(const QVariantMap &overrides);
+    void applyConfiguration(const Configuration &configuration);
 
     void run();
 
+    // Advertising timeout in seconds, 0 for the configured one
+    RequestResult requestStart(int timeout = 0);
+    RequestResult requestStop();
+
+public slots:
+    bool reloadConfiguration();
+
+signals:
+    void modeChanged(Mode mode);
+    void serverStateChanged();
+    void networkManagerStateChanged(NetworkManager::NetworkManagerState state);
+
 private:
     NetworkManager *m_networkManager = nullptr;
+    NetworkManagerWatcher *m_networkManagerWatcher = nullptr;
+    NetworkManagerProfile m_networkManagerProfile = NetworkManagerProfileFull;
+    bool m_networkManagerLoading = false;
+    bool m_startPending = false;
+    bool m_networkManagerStateReported = false;
+    NetworkManager::NetworkManagerState m_networkManagerState = NetworkManager::NetworkManagerStateUnknown;
     BluetoothServer *m_bluetoothServer = nullptr;
     NymeadService *m_nymeaService = nullptr;
-    WirelessNetworkDevice *m_wirelessDevice = nullptr;
+    QPointer<WirelessNetworkDevice> m_wirelessDevice;
+    int m_scanMaxAge = 0;
+    QElapsedTimer m_lastScan;
+    bool m_prewarmed = false;
+    bool m_bluetoothAdaptersLogged = false;
+    NymeaNetworkManagerDBusService *m_dbusService = nullptr;
     QList<GpioButton*> m_buttons;
+    GpioInputEngine *m_gpioInputEngine = nullptr;
+
+    QString m_configurationFileName;
+    QVariantMap m_configurationOverrides;
+    QVariantMap m_configurationFileValues;
+    QFileSystemWatcher *m_configurationWatcher = nullptr;
+    QTimer *m_configurationReloadTimer = nullptr;
 
     QTimer *m_advertisingTimer = nullptr;
+    QTimer *m_restartTimer = nullptr;
+    QTimer *m_offlineDebounceTimer = nullptr;
+    QTimer *m_idleExitTimer = nullptr;
+    QTimer *m_scanTimer = nullptr;
+
+    struct Transition {
+        qint64 timestamp;
+        State from;
+        State to;
+        Event event;
+    };
+
+    State m_state = StateWaiting;
+    QElapsedTimer m_stateClock;
+    QList<Transition> m_transitions;
+
+    struct Session {
+        qint64 started;
+        qint64 duration;
+        bool online;
+    };
+
+    QList<Session> m_sessions;
+    bool m_sessionActive = false;
+    int m_sessionCount = 0;
+    int m_maxSessions = 1;
 
     Mode m_mode = ModeOffline;
     QString m_advertiseName;
     bool m_forceFullName = false;
     QString m_platformName;
     int m_advertisingTimeout = 60;
+    TimeoutPolicy m_timeoutPolicy = TimeoutPolicyFixed;
+    AdaptiveTimeout m_adaptiveTimeout;
+    NetworkSnapshot m_networkSnapshot;
+    QString m_stateDirectory;
+    int m_offlineDebounce = 1000;
+    bool m_idleExit = false;
+    int m_dutyCycleOn = 0;
+    int m_dutyCycleOff = 0;
+    QTime m_scheduleStart;
+    QTime m_scheduleEnd;
+    bool m_dutyCycleOffWindow = false;
+    int m_buttonGpio = -1;
+    bool m_buttonActiveLow = false;
+    QString m_buttonChip;
+    int m_buttonLongPress = 2000;
+    int m_buttonDebounce = 50;
+    QString m_dbusBusType;
+    bool m_restartPending = false;
+    bool m_dbusStartPending = false;
+    bool m_waitingForNymea = false;
+    int m_dbusStartTimeout = 0;
+    bool m_readyNotified = false;
+
+    ProvisioningMetrics m_metrics;
+
+    bool m_measureStartup = false;
+    QElapsedTimer m_startupTimer;
+    qint64 m_runTimestamp = -1;
+    bool m_firstAdvertisementMeasured = false;
 
+    bool m_reportMemory = false;
+
+    // Benchmark: stop after the first advertisement, print the results and quit
+    bool m_benchmark = false;
+    qint64 m_advertiseTimestamp = -1;
+    qint64 m_stopTimestamp = -1;
+    bool m_measurementWatchdog = false;
+    qint64 m_maxStall = 0;
+
+    void finishStartupMeasurement();
+    void finishBenchmark(bool success);
+
+    void processEvent(Event event);
+    void setState(State state, Event event);
+    bool serverActive() const;
+    void notifyReady();
+    bool advertisingPossible() const;
+    bool idleExitPossible() const;
+
+    int advertisingWindow() const;
+    void updateWirelessDevice();
+    void refreshAccessPoints();
+    void logBluetoothAdapters();
+
+    bool timedWindow() const;
+    bool dutyCycled() const;
+    bool withinSchedule() const;
+    int onWindow() const;
+    int offWindow() const;
+    void evaluateIdleExit();
+
+    bool networkManagerAvailable() const;
+    int connectionCount() const;
+    void loadNetworkManager();
+    void replaceNetworkManagerWatcher();
+
+    void evaluateMode();
+    void evaluateNetworkManagerAvailable(bool available);
     void evaluateNetworkManagerState(NetworkManager::NetworkManagerState state);
 
+    void enableButtons();
+    void disableButtons();
+    void createBluetoothServer();
+    void prepareBluetoothServer();
+    void launchBluetoothServer();
+    void prewarm();
+    void logMemoryReport();
+
+    bool startServer();
+    void stopServer();
+
 private slots:
     void startService();
     void stopService();
 
     void onAdvertisingTimeout();
+    void onRestartTimeout();
+    void onOfflineDebounceTimeout();
+    void onIdleExitTimeout();
+    void onScanTimeout();
+    void onConfigurationFileChanged(const QString &fileName);
+
+    void onBenchmarkTimeout();
+
+    void onButtonLongPressed();
 
     void onDBusStartRequested();
     void onDBusStopRequested();
@@ -104,8 +363,10 @@ private slots:
 
     void onNetworkManagerAvailableChanged(bool available);
     void onNetworkManagerStateChanged(NetworkManager::NetworkManagerState state);
+    void onNetworkManagerWatcherAvailableChanged(bool available);
 
     void onNymeaServiceAvailableChanged(bool available);
+    void onNymeaBluetoothEnableFinished(bool enable, bool success);
 
 };
 
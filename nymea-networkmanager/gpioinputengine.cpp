@@ -0,0 +1,284 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "gpioinputengine.h"
+
+#include <QMap>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/gpio.h>
+
+#ifndef GPIO_V2_LINES_MAX
+#error "The GPIO character device requires the v2 uAPI of the kernel headers 5.10 or newer"
+#endif
+
+Q_LOGGING_CATEGORY(dcGpio, "Gpio")
+
+GpioInputEngine::GpioInputEngine(const QString &chip, QObject *parent) :
+    QObject(parent),
+    m_chip(chip)
+{
+    m_clock.start();
+
+    m_longPressTimer = new QTimer(this);
+    m_longPressTimer->setSingleShot(true);
+    connect(m_longPressTimer, &QTimer::timeout, this, &GpioInputEngine::onLongPressTimeout);
+}
+
+GpioInputEngine::~GpioInputEngine()
+{
+    disable();
+}
+
+QString GpioInputEngine::chip() const
+{
+    return m_chip;
+}
+
+void GpioInputEngine::addButton(uint offset, bool activeLow, int longPressTimeout, int debounce)
+{
+    if (m_fd >= 0) {
+        qCWarning(dcGpio()) << "Cannot add GPIO line" << offset << "while the lines of" << m_chip << "are requested.";
+        return;
+    }
+
+    Button button;
+    button.offset = offset;
+    button.activeLow = activeLow;
+    button.longPressTimeout = longPressTimeout;
+    button.debounce = debounce;
+    button.pressedSince = -1;
+    button.longPressReported = false;
+    m_buttons.append(button);
+}
+
+QList<uint> GpioInputEngine::offsets() const
+{
+    QList<uint> offsets;
+    foreach (const Button &button, m_buttons)
+        offsets.append(button.offset);
+
+    return offsets;
+}
+
+bool GpioInputEngine::enable()
+{
+    if (m_fd >= 0)
+        return true;
+
+    if (m_buttons.isEmpty() || m_buttons.count() > GPIO_V2_LINES_MAX) {
+        qCWarning(dcGpio()) << "Cannot request" << m_buttons.count() << "GPIO lines from" << m_chip;
+        return false;
+    }
+
+    int chipFd = ::open(m_chip.toLocal8Bit().constData(), O_RDONLY | O_CLOEXEC);
+    if (chipFd < 0) {
+        qCWarning(dcGpio()) << "Could not open" << m_chip << strerror(errno);
+        return false;
+    }
+
+    struct gpio_v2_line_request request;
+    memset(&request, 0, sizeof(request));
+    strncpy(request.consumer, "nymea-networkmanager", sizeof(request.consumer) - 1);
+    request.num_lines = static_cast<__u32>(m_buttons.count());
+    request.config.flags = GPIO_V2_LINE_FLAG_INPUT | GPIO_V2_LINE_FLAG_EDGE_RISING | GPIO_V2_LINE_FLAG_EDGE_FALLING;
+
+    // Lines sharing the same setting share one attribute, selected by the mask of line indices
+    quint64 activeLowMask = 0;
+    QMap<int, quint64> debounceMasks;
+    for (int i = 0; i < m_buttons.count(); i++) {
+        request.offsets[i] = m_buttons.at(i).offset;
+        if (m_buttons.at(i).activeLow)
+            activeLowMask |= Q_UINT64_C(1) << i;
+
+        if (m_buttons.at(i).debounce > 0)
+            debounceMasks[m_buttons.at(i).debounce] |= Q_UINT64_C(1) << i;
+    }
+
+    if (debounceMasks.count() + (activeLowMask ? 1 : 0) > GPIO_V2_LINE_NUM_ATTRS_MAX) {
+        qCWarning(dcGpio()) << "Too many different debounce periods for the GPIO lines of" << m_chip;
+        ::close(chipFd);
+        return false;
+    }
+
+    uint attribute = 0;
+    if (activeLowMask) {
+        request.config.attrs[attribute].attr.id = GPIO_V2_LINE_ATTR_ID_FLAGS;
+        request.config.attrs[attribute].attr.flags = request.config.flags | GPIO_V2_LINE_FLAG_ACTIVE_LOW;
+        request.config.attrs[attribute].mask = activeLowMask;
+        attribute++;
+    }
+
+    foreach (int debounce, debounceMasks.keys()) {
+        request.config.attrs[attribute].attr.id = GPIO_V2_LINE_ATTR_ID_DEBOUNCE;
+        request.config.attrs[attribute].attr.debounce_period_us = static_cast<__u32>(debounce) * 1000;
+        request.config.attrs[attribute].mask = debounceMasks.value(debounce);
+        attribute++;
+    }
+    request.config.num_attrs = attribute;
+
+    int result = ioctl(chipFd, GPIO_V2_GET_LINE_IOCTL, &request);
+    int requestError = errno;
+    ::close(chipFd);
+    if (result < 0) {
+        qCWarning(dcGpio()) << "Could not request the GPIO lines" << offsets() << "from" << m_chip << strerror(requestError);
+        return false;
+    }
+
+    m_fd = request.fd;
+    fcntl(m_fd, F_SETFL, fcntl(m_fd, F_GETFL) | O_NONBLOCK);
+
+    // Start with the current values, the edge events only report changes
+    struct gpio_v2_line_values values;
+    memset(&values, 0, sizeof(values));
+    values.mask = (m_buttons.count() == 64) ? ~Q_UINT64_C(0) : (Q_UINT64_C(1) << m_buttons.count()) - 1;
+    if (ioctl(m_fd, GPIO_V2_LINE_GET_VALUES_IOCTL, &values) >= 0) {
+        for (int i = 0; i < m_buttons.count(); i++) {
+            if (values.bits & (Q_UINT64_C(1) << i)) {
+                setPressed(m_buttons[i], true);
+            }
+        }
+    }
+    scheduleLongPress();
+
+    m_notifier = new QSocketNotifier(m_fd, QSocketNotifier::Read, this);
+    connect(m_notifier, &QSocketNotifier::activated, this, &GpioInputEngine::onActivated);
+
+    qCDebug(dcGpio()) << "Watching the GPIO lines" << offsets() << "of" << m_chip;
+    return true;
+}
+
+void GpioInputEngine::disable()
+{
+    if (m_fd < 0)
+        return;
+
+    // The notifier may be the sender of the current call
+    m_notifier->setEnabled(false);
+    m_notifier->deleteLater();
+    m_notifier = nullptr;
+    ::close(m_fd);
+    m_fd = -1;
+
+    m_longPressTimer->stop();
+    for (int i = 0; i < m_buttons.count(); i++) {
+        m_buttons[i].pressedSince = -1;
+        m_buttons[i].longPressReported = false;
+    }
+}
+
+bool GpioInputEngine::enabled() const
+{
+    return m_fd >= 0;
+}
+
+void GpioInputEngine::setPressed(Button &button, bool pressed)
+{
+    if (pressed == (button.pressedSince >= 0))
+        return;
+
+    if (pressed) {
+        button.pressedSince = m_clock.elapsed();
+        button.longPressReported = false;
+        emit this->pressed(button.offset);
+    } else {
+        button.pressedSince = -1;
+        emit released(button.offset);
+    }
+}
+
+void GpioInputEngine::scheduleLongPress()
+{
+    // One timer for all buttons, due for the earliest long press
+    qint64 next = -1;
+    foreach (const Button &button, m_buttons) {
+        if (button.pressedSince < 0 || button.longPressReported)
+            continue;
+
+        qint64 due = button.pressedSince + button.longPressTimeout;
+        if (next < 0 || due < next)
+            next = due;
+    }
+
+    if (next < 0) {
+        m_longPressTimer->stop();
+        return;
+    }
+
+    m_longPressTimer->start(static_cast<int>(qMax<qint64>(0, next - m_clock.elapsed())));
+}
+
+void GpioInputEngine::onActivated()
+{
+    // Drain all queued events of all lines with as few reads as possible
+    struct gpio_v2_line_event events[16];
+    forever {
+        ssize_t size = ::read(m_fd, events, sizeof(events));
+        if (size < 0 && errno == EINTR)
+            continue;
+
+        if (size < 0 && errno != EAGAIN) {
+            // The notifier would keep firing on a broken file descriptor
+            qCWarning(dcGpio()) << "Could not read GPIO events from" << m_chip << strerror(errno) << "Disabling the buttons.";
+            disable();
+            return;
+        }
+
+        if (size <= 0)
+            break;
+
+        for (size_t i = 0; i < static_cast<size_t>(size) / sizeof(struct gpio_v2_line_event); i++) {
+            for (int j = 0; j < m_buttons.count(); j++) {
+                if (m_buttons.at(j).offset == events[i].offset) {
+                    // Edges refer to the logical value, active low lines are inverted already
+                    setPressed(m_buttons[j], events[i].id == GPIO_V2_LINE_EVENT_RISING_EDGE);
+                    break;
+                }
+            }
+        }
+    }
+
+    scheduleLongPress();
+}
+
+void GpioInputEngine::onLongPressTimeout()
+{
+    qint64 now = m_clock.elapsed();
+    for (int i = 0; i < m_buttons.count(); i++) {
+        Button &button = m_buttons[i];
+        if (button.pressedSince < 0 || button.longPressReported || now < button.pressedSince + button.longPressTimeout)
+            continue;
+
+        button.longPressReported = true;
+        qCDebug(dcGpio()) << "GPIO line" << button.offset << "long pressed";
+        emit longPressed(button.offset);
+    }
+
+    scheduleLongPress();
+}
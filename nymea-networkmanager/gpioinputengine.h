@@ -0,0 +1,89 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef GPIOINPUTENGINE_H
+#define GPIOINPUTENGINE_H
+
+#include <QList>
+#include <QTimer>
+#include <QObject>
+#include <QElapsedTimer>
+#include <QSocketNotifier>
+#include <QLoggingCategory>
+
+Q_DECLARE_LOGGING_CATEGORY(dcGpio)
+
+// Watches all button lines of a GPIO chip through a single line request on the
+// character device. The kernel debounces the lines and queues the edge events
+// on one fd, a single timer detects the long presses of all buttons.
+class GpioInputEngine : public QObject
+{
+    Q_OBJECT
+public:
+    explicit GpioInputEngine(const QString &chip, QObject *parent = nullptr);
+    ~GpioInputEngine();
+
+    QString chip() const;
+
+    // All buttons have to be added before enabling, the lines get requested at once
+    void addButton(uint offset, bool activeLow = false, int longPressTimeout = 2000, int debounce = 50);
+    QList<uint> offsets() const;
+
+    bool enable();
+    void disable();
+    bool enabled() const;
+
+signals:
+    void pressed(uint offset);
+    void released(uint offset);
+    void longPressed(uint offset);
+
+private:
+    struct Button {
+        uint offset;
+        bool activeLow;
+        int longPressTimeout;
+        int debounce;
+        qint64 pressedSince;
+        bool longPressReported;
+    };
+
+    QString m_chip;
+    QList<Button> m_buttons;
+    int m_fd = -1;
+    QSocketNotifier *m_notifier = nullptr;
+    QTimer *m_longPressTimer = nullptr;
+    QElapsedTimer m_clock;
+
+    void setPressed(Button &button, bool pressed);
+    void scheduleLongPress();
+
+private slots:
+    void onActivated();
+    void onLongPressTimeout();
+
+};
+
+#endif // GPIOINPUTENGINE_H
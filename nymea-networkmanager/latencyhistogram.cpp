@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "latencyhistogram.h"
+
+#include <string.h>
+
+LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+void LatencyHistogram::record(qint64 value)
+{
+    if (value < 0)
+        value = 0;
+
+    m_counts[indexForValue(value)]++;
+    m_minimum = m_count == 0 ? value : qMin(m_minimum, value);
+    m_maximum = m_count == 0 ? value : qMax(m_maximum, value);
+    m_sum += value;
+    m_count++;
+}
+
+void LatencyHistogram::reset()
+{
+    memset(m_counts, 0, sizeof(m_counts));
+    m_count = 0;
+    m_minimum = 0;
+    m_maximum = 0;
+    m_sum = 0;
+}
+
+quint64 LatencyHistogram::count() const
+{
+    return m_count;
+}
+
+qint64 LatencyHistogram::minimum() const
+{
+    return m_minimum;
+}
+
+qint64 LatencyHistogram::maximum() const
+{
+    return m_maximum;
+}
+
+double LatencyHistogram::mean() const
+{
+    return m_count == 0 ? 0 : m_sum / m_count;
+}
+
+qint64 LatencyHistogram::valueAtPercentile(double percentile) const
+{
+    if (m_count == 0)
+        return 0;
+
+    quint64 threshold = qMax<quint64>(1, static_cast<quint64>(percentile / 100.0 * m_count + 0.5));
+    quint64 total = 0;
+    for (int i = 0; i < s_bucketCount * s_subBucketCount; i++) {
+        total += m_counts[i];
+        if (total >= threshold) {
+            return qMin(upperBoundForIndex(i), m_maximum);
+        }
+    }
+
+    return m_maximum;
+}
+
+QVariantMap LatencyHistogram::toVariantMap() const
+{
+    QVariantMap map;
+    map.insert("count", m_count);
+    map.insert("min", m_minimum);
+    map.insert("max", m_maximum);
+    map.insert("mean", mean());
+    map.insert("p50", valueAtPercentile(50));
+    map.insert("p90", valueAtPercentile(90));
+    map.insert("p99", valueAtPercentile(99));
+
+    // Only the non empty buckets, keyed by their upper bound, so histograms can be merged
+    QVariantMap buckets;
+    for (int i = 0; i < s_bucketCount * s_subBucketCount; i++) {
+        if (m_counts[i] > 0) {
+            buckets.insert(QString::number(upperBoundForIndex(i)), m_counts[i]);
+        }
+    }
+    map.insert("buckets", buckets);
+    return map;
+}
+
+int LatencyHistogram::indexForValue(qint64 value)
+{
+    // Values below the sub bucket count are stored exactly in the first bucket
+    if (value < s_subBucketCount)
+        return static_cast<int>(value);
+
+    int magnitude = 63 - __builtin_clzll(static_cast<quint64>(value));
+    int bucket = magnitude - s_subBucketBits + 1;
+    if (bucket >= s_bucketCount)
+        return s_bucketCount * s_subBucketCount - 1;
+
+    int subBucket = static_cast<int>((value >> (bucket - 1)) & (s_subBucketCount - 1));
+    return bucket * s_subBucketCount + subBucket;
+}
+
+qint64 LatencyHistogram::upperBoundForIndex(int index)
+{
+    int bucket = index / s_subBucketCount;
+    int subBucket = index % s_subBucketCount;
+    if (bucket == 0)
+        return subBucket;
+
+    return ((static_cast<qint64>(s_subBucketCount + subBucket) + 1) << (bucket - 1)) - 1;
+}
@@ -0,0 +1,66 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef LATENCYHISTOGRAM_H
+#define LATENCYHISTOGRAM_H
+
+#include <QVariantMap>
+
+// HDR style histogram with log-linear buckets: each power of two range is split
+// into 16 linear sub buckets, which gives a constant relative error of ~6 %
+// from 1 ms up to more than one day with a fixed memory footprint.
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(qint64 value);
+    void reset();
+
+    quint64 count() const;
+    qint64 minimum() const;
+    qint64 maximum() const;
+    double mean() const;
+    qint64 valueAtPercentile(double percentile) const;
+
+    QVariantMap toVariantMap() const;
+
+private:
+    static const int s_subBucketBits = 4;
+    static const int s_subBucketCount = 1 << s_subBucketBits;
+    static const int s_bucketCount = 28;
+
+    quint32 m_counts[s_bucketCount * s_subBucketCount];
+    quint64 m_count = 0;
+    qint64 m_minimum = 0;
+    qint64 m_maximum = 0;
+    double m_sum = 0;
+
+    static int indexForValue(qint64 value);
+    static qint64 upperBoundForIndex(int index);
+
+};
+
+#endif // LATENCYHISTOGRAM_H
@@ -0,0 +1,308 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "logengine.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <syslog.h>
+#include <systemd/sd-journal.h>
+
+static const char *const normal = "\033[0m";
+static const char *const warning = "\e[33m";
+static const char *const error = "\e[31m";
+
+// Encode into the given buffer without allocating, truncating at a character boundary
+static int encodeUtf8(const QString &string, char *buffer, int size)
+{
+    const ushort *data = string.utf16();
+    const int length = string.length();
+    int position = 0;
+
+    for (int i = 0; i < length; i++) {
+        uint code = data[i];
+        if (QChar::isHighSurrogate(code) && i + 1 < length && QChar::isLowSurrogate(data[i + 1])) {
+            code = QChar::surrogateToUcs4(data[i], data[i + 1]);
+            i++;
+        }
+
+        int bytes = code < 0x80 ? 1 : (code < 0x800 ? 2 : (code < 0x10000 ? 3 : 4));
+        if (position + bytes >= size)
+            break;
+
+        switch (bytes) {
+        case 1:
+            buffer[position++] = static_cast<char>(code);
+            break;
+        case 2:
+            buffer[position++] = static_cast<char>(0xC0 | (code >> 6));
+            buffer[position++] = static_cast<char>(0x80 | (code & 0x3F));
+            break;
+        case 3:
+            buffer[position++] = static_cast<char>(0xE0 | (code >> 12));
+            buffer[position++] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            buffer[position++] = static_cast<char>(0x80 | (code & 0x3F));
+            break;
+        default:
+            buffer[position++] = static_cast<char>(0xF0 | (code >> 18));
+            buffer[position++] = static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            buffer[position++] = static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            buffer[position++] = static_cast<char>(0x80 | (code & 0x3F));
+            break;
+        }
+    }
+
+    buffer[position] = '\0';
+    return position;
+}
+
+LogEngine *LogEngine::instance()
+{
+    static LogEngine *engine = new LogEngine();
+    return engine;
+}
+
+LogEngine::LogEngine(QObject *parent) :
+    QThread(parent)
+{
+    // Systemd sets this variable if stdout/stderr are connected to the journal
+    m_journalEnabled = qEnvironmentVariableIsSet("JOURNAL_STREAM");
+}
+
+void LogEngine::startWriter()
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_running)
+        return;
+
+    m_running = true;
+    start(QThread::LowPriority);
+}
+
+void LogEngine::stopWriter()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_running)
+            return;
+
+        m_running = false;
+        m_entriesAvailable.wakeOne();
+    }
+
+    // The writer drains all remaining entries before it returns
+    wait();
+}
+
+void LogEngine::flush()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_running && (m_count > 0 || m_writing)) {
+        m_entriesWritten.wait(&m_mutex);
+    }
+}
+
+bool LogEngine::journalEnabled() const
+{
+    return m_journalEnabled;
+}
+
+int LogEngine::droppedMessages() const
+{
+    return m_droppedMessages.loadRelaxed();
+}
+
+QHash<QString, bool> LogEngine::loggingFilters() const
+{
+    QMutexLocker locker(&m_filterMutex);
+    return m_loggingFilters;
+}
+
+void LogEngine::setLoggingFilter(const QString &category, bool enabled)
+{
+    QMutexLocker locker(&m_filterMutex);
+    m_loggingFilters.insert(category, enabled);
+}
+
+void LogEngine::installLoggingFilter()
+{
+    // Installing the filter again re-applies it to all existing categories
+    QLoggingCategory::installFilter(loggingCategoryFilter);
+}
+
+void LogEngine::log(QtMsgType type, const char *category, const QString &message)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Without writer thread (startup, shutdown) write the message directly. The application is
+    // going to abort after a fatal message, so it gets written directly too, even if the ring is full.
+    if (!m_running || type == QtFatalMsg) {
+        while (currentThread() != this && (m_count > 0 || m_writing)) {
+            m_entriesWritten.wait(&m_mutex);
+        }
+
+        Entry entry;
+        fillEntry(&entry, type, category, message);
+        writeEntries(&entry, 1);
+        return;
+    }
+
+    if (m_count == s_bufferSize) {
+        m_droppedMessages.fetchAndAddRelaxed(1);
+        return;
+    }
+
+    fillEntry(&m_entries[(m_head + m_count) % s_bufferSize], type, category, message);
+    m_count++;
+    m_entriesAvailable.wakeOne();
+}
+
+void LogEngine::run()
+{
+    QMutexLocker locker(&m_mutex);
+    forever {
+        while (m_running && m_count == 0) {
+            m_entriesAvailable.wait(&m_mutex);
+        }
+
+        if (m_count == 0)
+            break;
+
+        // Move one batch out of the ring so producers can continue while writing
+        int count = qMin(m_count, static_cast<int>(s_batchSize));
+        for (int i = 0; i < count; i++) {
+            memcpy(&m_batch[i], &m_entries[(m_head + i) % s_bufferSize], sizeof(Entry));
+        }
+        m_head = (m_head + count) % s_bufferSize;
+        m_count -= count;
+        m_writing = true;
+
+        locker.unlock();
+        writeEntries(m_batch, count);
+        locker.relock();
+
+        m_writing = false;
+        m_entriesWritten.wakeAll();
+    }
+}
+
+void LogEngine::loggingCategoryFilter(QLoggingCategory *category)
+{
+    const QHash<QString, bool> loggingFilters = instance()->loggingFilters();
+
+    // If this is a known category
+    if (loggingFilters.contains(category->categoryName())) {
+        category->setEnabled(QtDebugMsg, loggingFilters.value(category->categoryName()));
+        category->setEnabled(QtWarningMsg, true);
+        category->setEnabled(QtCriticalMsg, true);
+        category->setEnabled(QtFatalMsg, true);
+    } else {
+        //Disable default debug messages, print only >= warnings
+        category->setEnabled(QtDebugMsg, false);
+        category->setEnabled(QtWarningMsg, true);
+        category->setEnabled(QtCriticalMsg, true);
+        category->setEnabled(QtFatalMsg, true);
+    }
+}
+
+void LogEngine::fillEntry(Entry *entry, QtMsgType type, const char *category, const QString &message)
+{
+    entry->type = type;
+    if (category) {
+        strncpy(entry->category, category, s_categorySize - 1);
+        entry->category[s_categorySize - 1] = '\0';
+    } else {
+        entry->category[0] = '\0';
+    }
+    encodeUtf8(message, entry->message, s_messageSize);
+}
+
+void LogEngine::writeEntries(const Entry *entries, int count)
+{
+    int droppedMessages = m_droppedMessages.loadRelaxed();
+    int newlyDropped = droppedMessages - m_reportedDroppedMessages;
+    m_reportedDroppedMessages = droppedMessages;
+
+    if (m_journalEnabled) {
+        for (int i = 0; i < count; i++) {
+            int priority = LOG_DEBUG;
+            switch (entries[i].type) {
+            case QtInfoMsg:
+                priority = LOG_INFO;
+                break;
+            case QtDebugMsg:
+                priority = LOG_DEBUG;
+                break;
+            case QtWarningMsg:
+                priority = LOG_WARNING;
+                break;
+            case QtCriticalMsg:
+                priority = LOG_CRIT;
+                break;
+            case QtFatalMsg:
+                priority = LOG_ALERT;
+                break;
+            }
+            sd_journal_send("MESSAGE=%s", entries[i].message,
+                            "PRIORITY=%i", priority,
+                            "CATEGORY=%s", entries[i].category,
+                            NULL);
+        }
+
+        if (newlyDropped > 0)
+            sd_journal_send("MESSAGE=Dropped %i log messages", newlyDropped, "PRIORITY=%i", LOG_WARNING, NULL);
+
+        return;
+    }
+
+    int length = 0;
+    const int size = sizeof(m_output);
+    for (int i = 0; i < count; i++) {
+        const Entry &entry = entries[i];
+        switch (entry.type) {
+        case QtInfoMsg:
+        case QtDebugMsg:
+            length += snprintf(m_output + length, size - length, " I | %s: %s\n", entry.category, entry.message);
+            break;
+        case QtWarningMsg:
+            length += snprintf(m_output + length, size - length, "%s W | %s: %s%s\n", warning, entry.category, entry.message, normal);
+            break;
+        case QtCriticalMsg:
+            length += snprintf(m_output + length, size - length, "%s C | %s: %s%s\n", error, entry.category, entry.message, normal);
+            break;
+        case QtFatalMsg:
+            length += snprintf(m_output + length, size - length, "%s F | %s: %s%s\n", error, entry.category, entry.message, normal);
+            break;
+        }
+        length = qMin(length, size - 1);
+    }
+
+    if (newlyDropped > 0)
+        length += snprintf(m_output + length, size - length, "%s W | Application: Dropped %i log messages%s\n", warning, newlyDropped, normal);
+
+    fwrite(m_output, 1, qMin(length, size - 1), stdout);
+    fflush(stdout);
+}
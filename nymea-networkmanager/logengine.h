@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef LOGENGINE_H
+#define LOGENGINE_H
+
+#include <QHash>
+#include <QMutex>
+#include <QThread>
+#include <QAtomicInt>
+#include <QLoggingCategory>
+#include <QWaitCondition>
+
+// Log backend formatting messages into a preallocated ring buffer. A writer thread
+// drains the buffer in batches to stdout or, if available, natively to journald.
+// If the buffer is full the message gets dropped and counted instead of blocking,
+// fatal messages are always written directly before the application aborts.
+class LogEngine : public QThread
+{
+    Q_OBJECT
+public:
+    static LogEngine *instance();
+
+    void startWriter();
+    void stopWriter();
+    void flush();
+
+    bool journalEnabled() const;
+    int droppedMessages() const;
+
+    // Debug output per logging category, can be changed at runtime
+    QHash<QString, bool> loggingFilters() const;
+    void setLoggingFilter(const QString &category, bool enabled);
+    void installLoggingFilter();
+
+    void log(QtMsgType type, const char *category, const QString &message);
+
+protected:
+    void run() override;
+
+private:
+    explicit LogEngine(QObject *parent = nullptr);
+
+    static const int s_bufferSize = 256;
+    static const int s_batchSize = 32;
+    static const int s_categorySize = 48;
+    static const int s_messageSize = 512;
+
+    struct Entry {
+        QtMsgType type;
+        char category[s_categorySize];
+        char message[s_messageSize];
+    };
+
+    Entry m_entries[s_bufferSize];
+    Entry m_batch[s_batchSize];
+    char m_output[s_batchSize * (s_categorySize + s_messageSize + 32)];
+
+    QMutex m_mutex;
+    QWaitCondition m_entriesAvailable;
+    QWaitCondition m_entriesWritten;
+    int m_head = 0;
+    int m_count = 0;
+    bool m_running = false;
+    bool m_writing = false;
+
+    bool m_journalEnabled = false;
+    QAtomicInt m_droppedMessages;
+    int m_reportedDroppedMessages = 0;
+
+    mutable QMutex m_filterMutex;
+    QHash<QString, bool> m_loggingFilters;
+
+    static void loggingCategoryFilter(QLoggingCategory *category);
+
+    static void fillEntry(Entry *entry, QtMsgType type, const char *category, const QString &message);
+    void writeEntries(const Entry *entries, int count);
+
+};
+
+#endif // LOGENGINE_H
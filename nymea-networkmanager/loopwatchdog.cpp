@@ -0,0 +1,240 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "loopwatchdog.h"
+
+#include <systemd/sd-daemon.h>
+
+Q_LOGGING_CATEGORY(dcWatchdog, "Watchdog")
+
+QAtomicInt LoopWatchdog::s_watching;
+
+LoopWatchdog *LoopWatchdog::instance()
+{
+    static LoopWatchdog *watchdog = new LoopWatchdog();
+    return watchdog;
+}
+
+bool LoopWatchdog::systemdWatchdogEnabled()
+{
+    uint64_t usec = 0;
+    return sd_watchdog_enabled(0, &usec) > 0;
+}
+
+LoopWatchdog::LoopWatchdog(QObject *parent) :
+    QThread(parent)
+{
+
+}
+
+void LoopWatchdog::startWatching(int threshold, int interval)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_running)
+        return;
+
+    m_threshold = threshold > 0 ? threshold : s_defaultThreshold;
+    m_clock.start();
+    m_lastHeartbeat = 0;
+
+    // Notify twice per period as recommended by systemd
+    uint64_t usec = 0;
+    if (sd_watchdog_enabled(0, &usec) > 0) {
+        m_systemdInterval = qMax<qint64>(1, static_cast<qint64>(usec / 2000));
+        qCDebug(dcWatchdog()) << "Sending systemd watchdog notifications every" << m_systemdInterval << "ms";
+    }
+
+    // The heartbeat lives on the thread calling this, which is the main thread
+    m_heartbeatTimer = new QTimer();
+    m_heartbeatTimer->setInterval(interval > 0 ? interval : qMax(10, m_threshold / 4));
+    connect(m_heartbeatTimer, &QTimer::timeout, this, &LoopWatchdog::onHeartbeat);
+    m_heartbeatTimer->start();
+
+    qCDebug(dcWatchdog()) << "Watching the event loop with a threshold of" << m_threshold << "ms";
+    m_running = true;
+    s_watching.storeRelaxed(1);
+    start(QThread::LowPriority);
+}
+
+void LoopWatchdog::stopWatching()
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        if (!m_running)
+            return;
+
+        m_running = false;
+        s_watching.storeRelaxed(0);
+        m_stopRequested.wakeOne();
+    }
+
+    wait();
+
+    delete m_heartbeatTimer;
+    m_heartbeatTimer = nullptr;
+}
+
+bool LoopWatchdog::watching() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_running;
+}
+
+int LoopWatchdog::threshold() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_threshold;
+}
+
+int LoopWatchdog::stallCount() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_stallCount;
+}
+
+qint64 LoopWatchdog::maxStall() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maxStall;
+}
+
+QString LoopWatchdog::maxStallScope() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_maxStallScope;
+}
+
+QVariantMap LoopWatchdog::toVariantMap() const
+{
+    QMutexLocker locker(&m_mutex);
+    QVariantMap map;
+    map.insert("enabled", m_running);
+    map.insert("threshold", m_threshold);
+    map.insert("stalls", m_stallCount);
+    map.insert("maxStall", m_maxStall);
+    map.insert("maxStallScope", m_maxStallScope);
+    return map;
+}
+
+void LoopWatchdog::enterScope(const char *name)
+{
+    QMutexLocker locker(&m_mutex);
+    if (m_scopeCount < s_scopeDepth)
+        m_scopes[m_scopeCount] = name;
+
+    m_scopeCount++;
+}
+
+void LoopWatchdog::leaveScope(const char *name, qint64 duration)
+{
+    QMutexLocker locker(&m_mutex);
+    m_scopeCount--;
+
+    // Remember the outermost slow scope, the next heartbeat will account the stall to it
+    if (duration > m_threshold) {
+        m_slowScope = name;
+        locker.unlock();
+        qCWarning(dcWatchdog()) << name << "blocked the event loop for" << duration << "ms";
+    }
+}
+
+void LoopWatchdog::run()
+{
+    QMutexLocker locker(&m_mutex);
+    while (m_running) {
+        m_stopRequested.wait(&m_mutex, static_cast<unsigned long>(qMax(10, m_threshold / 4)));
+        if (!m_running)
+            break;
+
+        qint64 age = m_clock.elapsed() - m_lastHeartbeat;
+        if (age <= m_threshold || m_stallReported)
+            continue;
+
+        // Report once per stall, while it is still ongoing
+        m_stallReported = true;
+        QString stack = scopeStack();
+        locker.unlock();
+        qCWarning(dcWatchdog()).noquote() << "The event loop is blocked since" << age << "ms in" << stack;
+        locker.relock();
+    }
+}
+
+QString LoopWatchdog::scopeStack() const
+{
+    if (m_scopeCount == 0)
+        return QStringLiteral("<unknown>");
+
+    QStringList scopes;
+    for (int i = 0; i < qMin(m_scopeCount, static_cast<int>(s_scopeDepth)); i++)
+        scopes.append(QString::fromLatin1(m_scopes[i]));
+
+    if (m_scopeCount > s_scopeDepth)
+        scopes.append(QStringLiteral("..."));
+
+    return scopes.join(" > ");
+}
+
+void LoopWatchdog::onHeartbeat()
+{
+    QMutexLocker locker(&m_mutex);
+    qint64 now = m_clock.elapsed();
+    qint64 stall = now - m_lastHeartbeat - m_heartbeatTimer->interval();
+    m_lastHeartbeat = now;
+    m_stallReported = false;
+
+    // The longest stall is kept even below the threshold, the startup measurement reports it
+    if (stall > m_maxStall) {
+        m_maxStall = stall;
+        m_maxStallScope = m_slowScope ? QString::fromLatin1(m_slowScope) : QStringLiteral("<unknown>");
+    }
+
+    if (stall > m_threshold)
+        m_stallCount++;
+
+    m_slowScope = nullptr;
+
+    if (m_systemdInterval > 0 && now - m_lastSystemdNotification >= m_systemdInterval) {
+        m_lastSystemdNotification = now;
+        sd_notify(0, "WATCHDOG=1");
+    }
+}
+
+LoopWatchdogScope::LoopWatchdogScope(const char *name)
+{
+    if (!LoopWatchdog::s_watching.loadRelaxed())
+        return;
+
+    m_name = name;
+    m_timer.start();
+    LoopWatchdog::instance()->enterScope(m_name);
+}
+
+LoopWatchdogScope::~LoopWatchdogScope()
+{
+    if (!m_name)
+        return;
+
+    LoopWatchdog::instance()->leaveScope(m_name, m_timer.elapsed());
+}
@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef LOOPWATCHDOG_H
+#define LOOPWATCHDOG_H
+
+#include <QMutex>
+#include <QTimer>
+#include <QThread>
+#include <QVariant>
+#include <QAtomicInt>
+#include <QElapsedTimer>
+#include <QWaitCondition>
+#include <QLoggingCategory>
+
+Q_DECLARE_LOGGING_CATEGORY(dcWatchdog)
+
+// Watches the main event loop from a separate thread. A heartbeat timer on the main thread
+// stamps the loop, the watchdog thread warns once the stamp gets older than the threshold
+// and names the scopes which are currently running on the main thread (see WATCHDOG_SCOPE).
+// If systemd expects keep-alive messages they are sent from the heartbeat.
+class LoopWatchdog : public QThread
+{
+    Q_OBJECT
+public:
+    static LoopWatchdog *instance();
+    static bool systemdWatchdogEnabled();
+
+    // The heartbeat interval defaults to a quarter of the threshold, a shorter one measures short stalls too
+    void startWatching(int threshold = 0, int interval = 0);
+    void stopWatching();
+    bool watching() const;
+
+    int threshold() const;
+    int stallCount() const;
+    qint64 maxStall() const;
+    QString maxStallScope() const;
+    QVariantMap toVariantMap() const;
+
+    void enterScope(const char *name);
+    void leaveScope(const char *name, qint64 duration);
+
+protected:
+    void run() override;
+
+private:
+    explicit LoopWatchdog(QObject *parent = nullptr);
+
+    static const int s_defaultThreshold = 1000;
+    static const int s_scopeDepth = 8;
+
+    static QAtomicInt s_watching;
+    friend class LoopWatchdogScope;
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_stopRequested;
+    bool m_running = false;
+
+    QElapsedTimer m_clock;
+    QTimer *m_heartbeatTimer = nullptr;
+    qint64 m_lastHeartbeat = 0;
+    bool m_stallReported = false;
+    int m_threshold = s_defaultThreshold;
+
+    // Names of the nested scopes running on the main thread, string literals only
+    const char *m_scopes[s_scopeDepth];
+    int m_scopeCount = 0;
+    const char *m_slowScope = nullptr;
+
+    int m_stallCount = 0;
+    qint64 m_maxStall = 0;
+    QString m_maxStallScope;
+
+    qint64 m_systemdInterval = 0;
+    qint64 m_lastSystemdNotification = 0;
+
+    QString scopeStack() const;
+
+private slots:
+    void onHeartbeat();
+
+};
+
+// Measures the enclosing block and tells the watchdog which code is running on the main thread
+class LoopWatchdogScope
+{
+public:
+    explicit LoopWatchdogScope(const char *name);
+    ~LoopWatchdogScope();
+
+private:
+    const char *m_name = nullptr;
+    QElapsedTimer m_timer;
+};
+
+#define WATCHDOG_SCOPE() LoopWatchdogScope loopWatchdogScope(Q_FUNC_INFO)
+
+#endif // LOOPWATCHDOG_H
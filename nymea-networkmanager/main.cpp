@@ -25,73 +25,27 @@
 #include <QCoreApplication>
 #include <QCommandLineParser>
 #include <QCommandLineOption>
-#include <QSettings>
-#include <QStandardPaths>
-#include <QFileInfo>
 #include <QMetaEnum>
+#include <QElapsedTimer>
 
 #include "core.h"
+#include "logengine.h"
+#include "loopwatchdog.h"
+#include "configuration.h"
 #include "application.h"
 
-static const char *const normal = "\033[0m";
-static const char *const warning = "\e[33m";
-static const char *const error = "\e[31m";
-
-static QHash<QString, bool> s_loggingFilters;
-
-static void loggingCategoryFilter(QLoggingCategory *category)
-{
-    // If this is a known category
-    if (s_loggingFilters.contains(category->categoryName())) {
-        category->setEnabled(QtDebugMsg, s_loggingFilters.value(category->categoryName()));
-        category->setEnabled(QtWarningMsg, true);
-        category->setEnabled(QtCriticalMsg, true);
-        category->setEnabled(QtFatalMsg, true);
-    } else {
-        //Disable default debug messages, print only >= warnings
-        category->setEnabled(QtDebugMsg, false);
-        category->setEnabled(QtWarningMsg, true);
-        category->setEnabled(QtCriticalMsg, true);
-        category->setEnabled(QtFatalMsg, true);
-    }
-}
-
 static void consoleLogHandler(QtMsgType type, const QMessageLogContext& context, const QString& message)
 {
-    switch (type) {
-    case QtInfoMsg:
-        fprintf(stdout, " I | %s: %s\n", context.category, message.toUtf8().data());
-        break;
-    case QtDebugMsg:
-        fprintf(stdout, " I | %s: %s\n", context.category, message.toUtf8().data());
-        break;
-    case QtWarningMsg:
-        fprintf(stdout, "%s W | %s: %s%s\n", warning, context.category, message.toUtf8().data(), normal);
-        break;
-    case QtCriticalMsg:
-        fprintf(stdout, "%s C | %s: %s%s\n", error, context.category, message.toUtf8().data(), normal);
-        break;
-    case QtFatalMsg:
-        fprintf(stdout, "%s F | %s: %s%s\n", error, context.category, message.toUtf8().data(), normal);
-        break;
-    }
-    fflush(stdout);
+    LogEngine::instance()->log(type, context.category, message);
 }
 
 
 int main(int argc, char *argv[])
 {
-    qInstallMessageHandler(consoleLogHandler);
+    QElapsedTimer startupTimer;
+    startupTimer.start();
 
-    // Default configuration:
-    Core::Mode mode = Core::ModeOffline;
-    int timeout = 60;
-    int buttonGpio = -1;
-    bool buttonActiveLow = false;
-    QString advertiseName = "BT-WiFi";
-    bool forceFullName = false;
-    QString platformName = "nymea";
-    QString dbusBusType;
+    qInstallMessageHandler(consoleLogHandler);
 
     Application application(argc, argv);
     application.setOrganizationName("nymea");
@@ -120,188 +74,116 @@ int main(int argc, char *argv[])
     QCommandLineOption debugOption(QStringList() << "d" << "debug", "Enable more debug output.");
     parser.addOption(debugOption);
 
-    QCommandLineOption advertiseNameOption(QStringList() << "a" << "advertise-name", QString("The name of the bluetooth server. Default \"%1\". NOTE: The length is limited to 8 characters.").arg(advertiseName), "NAME");
-    advertiseNameOption.setDefaultValue(advertiseName);
-    parser.addOption(advertiseNameOption);
+    // The options of the configuration keys
+    Configuration::addCommandLineOptions(&parser);
 
-    QCommandLineOption forceFullNameOption(QStringList() << "f" << "force-name", QString("Enforce the full name to be used even if it is longer than 8 characters. IMPORTANT: This will displace the Service UUID in the discovery data which implies that client applications cannot discover the wifi setup service on this device any more."));
-    parser.addOption(forceFullNameOption);
+    QCommandLineOption measureStartupOption("measure-startup", "Log the time from the process start to Core::run() and from there to the first bluetooth advertisement.");
+    parser.addOption(measureStartupOption);
 
-    QCommandLineOption platformNameOption(QStringList() << "p" << "platform-name", QString("The name of the platform this daemon is running. Default \"%1\".").arg(platformName), "NAME");
-    platformNameOption.setDefaultValue(platformName);
-    parser.addOption(platformNameOption);
+    QCommandLineOption benchmarkOption("benchmark", "Measure the startup, stop the bluetooth server after the first advertisement, print the results as JSON and quit.");
+    parser.addOption(benchmarkOption);
 
-    QCommandLineOption gpioOption(QStringList() << "g" << "gpio", QString("The GPIO sysfs number for the button GPIO. This parameter is only needed for the \"button\" mode."), "GPIO");
-    platformNameOption.setDefaultValue("-1");
-    parser.addOption(gpioOption);
+    QCommandLineOption reportMemoryOption("report-memory", "Log the resident set, the heap usage and the number of objects per subsystem once the daemon is ready and each time the bluetooth server stopped.");
+    parser.addOption(reportMemoryOption);
 
-    QCommandLineOption timeoutOption(QStringList() << "t" << "timeout", QString("The timeout of the bluetooth server. Minimum value is 10. Default \"%1\".").arg(timeout), "SECONDS");
-    timeoutOption.setDefaultValue(QString::number(timeout));
-    parser.addOption(timeoutOption);
-
-    QCommandLineOption modeOption(QStringList() << "m" << "mode", "Run the daemon in a specific mode (offline, once, always, button, start). Default is \"offline\".", "MODE");
-    parser.addOption(modeOption);
-
-    QCommandLineOption dbusBusTypeOption({"b", "dbus-type"}, "If given, a DBus interface will be exposed on the chosen DBus bus type (session, system)", "DBUSTYPE");
-    parser.addOption(dbusBusTypeOption);
+    QCommandLineOption watchdogOption("watchdog", "Warn if the event loop is blocked for longer than the given threshold. Enabled with 1000 ms if systemd expects watchdog notifications.", "MS");
+    parser.addOption(watchdogOption);
 
     parser.process(application);
 
     // Enable debug categories
-    s_loggingFilters.insert("Application", true);
-    s_loggingFilters.insert("NymeaService", parser.isSet(debugOption));
-    s_loggingFilters.insert("NetworkManager", parser.isSet(debugOption) );
-    s_loggingFilters.insert("NetworkManagerBluetoothServer", parser.isSet(debugOption));
-    s_loggingFilters.insert("DBus", parser.isSet(debugOption));
-
-    QLoggingCategory::installFilter(loggingCategoryFilter);
-
-    bool timeoutValueOk = true;
-    bool gpioValueOk = true;
-
-    // Now read the cofig file, overriding defaults
-    QStringList configLocations;
-    configLocations << QStandardPaths::standardLocations(QStandardPaths::ConfigLocation);
-    configLocations << "/etc";
-    QString fileName = "/nymea/nymea-networkmanager.conf";
-    foreach (const QString &configLocation, configLocations) {
-        if (QFileInfo::exists(configLocation + fileName)) {
-            qCDebug(dcApplication) << "Using configuration file from:" << configLocation + fileName;
-            QSettings settings(configLocation + fileName, QSettings::IniFormat);
-
-            if (settings.contains("Mode")) {
-                if (settings.value("Mode").toString().toLower() == "offline") {
-                    mode = Core::ModeOffline;
-                } else if (settings.value("Mode").toString().toLower() == "always") {
-                    mode = Core::ModeAlways;
-                } else if (settings.value("Mode").toString().toLower() == "start") {
-                    mode = Core::ModeStart;
-                } else if (settings.value("Mode").toString().toLower() == "once") {
-                    mode = Core::ModeOnce;
-                } else if (settings.value("Mode").toString().toLower() == "button") {
-                    mode = Core::ModeButton;
-                } else if (settings.value("Mode").toString().toLower() == "dbus") {
-                    mode = Core::ModeDBus;
-                } else {
-                    qCWarning(dcApplication()).noquote() << QString("The config file's mode \"%1\" does not match the allowed modes.").arg(settings.value("Mode").toString());
-                }
-            }
-
-            if (settings.contains("ButtonGpio"))
-                buttonGpio = settings.value("ButtonGpio", -1).toInt(&gpioValueOk);
-
-            if (settings.contains("ButtonActiveLow"))
-                buttonActiveLow = settings.value("ButtonActiveLow", false).toBool();
-
-            if (settings.contains("Timeout"))
-                timeout = settings.value("Timeout").toInt(&timeoutValueOk);
-
-            if (settings.contains("AdvertiseName"))
-                advertiseName = settings.value("AdvertiseName").toString();
-
-            if (settings.contains("ForceFullName"))
-                forceFullName = settings.value("ForceFullName").toBool();
-
-            if (settings.contains("PlatformName"))
-                platformName = settings.value("PlatformName").toString();
-
-            if (settings.contains("DBusBusType"))
-                dbusBusType = settings.value("DBusBusType").toString();
-
-            break;
-        }
+    LogEngine::instance()->setLoggingFilter("Application", true);
+    LogEngine::instance()->setLoggingFilter("NymeaService", parser.isSet(debugOption));
+    LogEngine::instance()->setLoggingFilter("NetworkManager", parser.isSet(debugOption));
+    LogEngine::instance()->setLoggingFilter("NetworkManagerBluetoothServer", parser.isSet(debugOption));
+    LogEngine::instance()->setLoggingFilter("NetworkManagerWatcher", parser.isSet(debugOption));
+    LogEngine::instance()->setLoggingFilter("DBus", parser.isSet(debugOption));
+    LogEngine::instance()->setLoggingFilter("Watchdog", parser.isSet(debugOption));
+    LogEngine::instance()->setLoggingFilter("Gpio", parser.isSet(debugOption));
+    LogEngine::instance()->installLoggingFilter();
+
+    // Command line values have the higher priority and will be kept on reloading the configuration
+    QVariantMap overrides = Configuration::commandLineOverrides(parser);
+
+    QString configurationFileName = Configuration::findConfigurationFile();
+    if (!configurationFileName.isEmpty())
+        qCDebug(dcApplication) << "Using configuration file from:" << configurationFileName;
+
+    Configuration configuration;
+    if (!configuration.load(configurationFileName, overrides)) {
+        qCCritical(dcApplication()).noquote() << configuration.errorString();
+        return 1;
     }
 
-    // Now parse command line
-    if (parser.isSet(modeOption)) {
-        if (parser.value(modeOption).toLower() == "offline") {
-            mode = Core::ModeOffline;
-        } else if (parser.value(modeOption).toLower() == "always") {
-            mode = Core::ModeAlways;
-        } else if (parser.value(modeOption).toLower() == "start") {
-            mode = Core::ModeStart;
-        } else if (parser.value(modeOption).toLower() == "once") {
-            mode = Core::ModeOnce;
-        } else if (parser.value(modeOption).toLower() == "button") {
-            mode = Core::ModeButton;
-        }  else if (parser.value(modeOption).toLower() == "dbus") {
-            mode = Core::ModeDBus;
-        }  else {
-            qCWarning(dcApplication()).noquote() << QString("The given mode \"%1\" does not match the allowed modes.").arg(parser.value(modeOption));
-            parser.showHelp(1);
+    qCDebug(dcApplication()) << "=====================================";
+    qCDebug(dcApplication()) << "Starting nymea-networkmanager" << application.applicationVersion();
+    qCDebug(dcApplication()) << "=====================================";
+    qCDebug(dcApplication()) << "Advertising name:" << configuration.advertiseName;
+    qCDebug(dcApplication()) << "Platform name:" << configuration.platformName;
+    qCDebug(dcApplication()) << "Mode:" << configuration.mode;
+    qCDebug(dcApplication()) << "Timeout:" << configuration.timeout << configuration.timeoutPolicy;
+    if (configuration.mode == Core::ModeOffline)
+        qCDebug(dcApplication()) << "Offline debounce:" << configuration.offlineDebounce << "ms";
+
+    if (configuration.mode == Core::ModeAlways && configuration.dutyCycleOn > 0)
+        qCDebug(dcApplication()) << "Duty cycle:" << configuration.dutyCycleOn << "s on," << configuration.dutyCycleOff << "s off";
+
+    if (configuration.mode == Core::ModeAlways && configuration.scheduleStart.isValid())
+        qCDebug(dcApplication()).noquote() << "Advertising schedule:" << configuration.scheduleStart.toString("HH:mm") << "-" << configuration.scheduleEnd.toString("HH:mm");
+
+    if (configuration.idleExit)
+        qCDebug(dcApplication()) << "Exit once the bluetooth server will not be started again";
+
+    if (configuration.mode == Core::ModeButton && configuration.buttonGpio >= 0) {
+        if (configuration.buttonChip.isEmpty()) {
+            qCDebug(dcApplication()) << QString("Button GPIO: %1 (Active %2)").arg(configuration.buttonGpio).arg(configuration.buttonActiveLow ? "low" : "high");
+        } else {
+            qCDebug(dcApplication()) << QString("Button GPIO: %1 line %2 (Active %3)").arg(configuration.buttonChip).arg(configuration.buttonGpio).arg(configuration.buttonActiveLow ? "low" : "high");
         }
+        qCDebug(dcApplication()) << "Button long press:" << configuration.buttonLongPress << "ms";
     }
-    if (parser.isSet(advertiseNameOption))
-        advertiseName = parser.value(advertiseNameOption);
-
-    if (parser.isSet(forceFullNameOption))
-        forceFullName = true;
-
-    if (parser.isSet(platformNameOption))
-        platformName = parser.value(platformNameOption);
-
-    if (parser.isSet(timeoutOption))
-        timeout = parser.value(timeoutOption).toInt(&timeoutValueOk);
-
-    if (parser.isSet(gpioOption))
-        buttonGpio = parser.value(gpioOption).toInt(&gpioValueOk);
-
-    if (parser.isSet(dbusBusTypeOption))
-        dbusBusType = parser.value(dbusBusTypeOption);
 
-    // All parsed. Validate input:
-    if (!timeoutValueOk) {
-        qCCritical(dcApplication()) << QString("Invalid timeout value passed: \"%1\". Please pass an integer >= 10").arg(parser.value(timeoutOption));
-        return(1);
-    }
-    if (!gpioValueOk) {
-        qCCritical(dcApplication()) << QString("Invalid GPIO number value passed: \"%1\". Please pass an integer > 0").arg(parser.value(gpioOption));
-        return(1);
-    }
-    if (timeout < 10) {
-        qCCritical(dcApplication()) << QString("Invalid timeout value passed: \"%1\". The minimal timeout is 10 [s].").arg(parser.value(timeoutOption));
-        return(1);
+    if (!configuration.dbusBusType.isEmpty() && configuration.dbusBusType != "none")
+        qCDebug(dcApplication()) << "DBus interface:" << configuration.dbusBusType;
+
+    // Move log output off the main thread
+    LogEngine::instance()->startWriter();
+
+    // Watch the event loop if requested or if systemd expects keep-alive messages
+    if (parser.isSet(watchdogOption) || LoopWatchdog::systemdWatchdogEnabled()) {
+        int watchdogThreshold = 0;
+        if (parser.isSet(watchdogOption)) {
+            bool thresholdValueOk = false;
+            watchdogThreshold = parser.value(watchdogOption).toInt(&thresholdValueOk);
+            if (!thresholdValueOk || watchdogThreshold <= 0) {
+                qCCritical(dcApplication()) << "Invalid watchdog threshold passed:" << parser.value(watchdogOption);
+                LogEngine::instance()->stopWriter();
+                return 1;
+            }
+        }
+        LoopWatchdog::instance()->startWatching(watchdogThreshold);
     }
 
-    if (mode == Core::ModeButton && buttonGpio <= 0) {
-        qCWarning(dcApplication()) << "Button mode selected but no valid GPIO passed. The button will not work!";
-        return 1;
-    }
+    // Start core
+    Core core(&application);
+    if (parser.isSet(measureStartupOption) || parser.isSet(benchmarkOption))
+        core.enableStartupMeasurement(startupTimer, parser.isSet(benchmarkOption));
 
-    if (!dbusBusType.isEmpty() && dbusBusType != "system" && dbusBusType != "session" && dbusBusType != "none") {
-        qCCritical(dcApplication()) << "Invalid DBus bus type:" << dbusBusType;
-        return 1;
-    }
+    if (parser.isSet(reportMemoryOption))
+        core.enableMemoryReport();
 
-    qCDebug(dcApplication()) << "=====================================";
-    qCDebug(dcApplication()) << "Starting nymea-networkmanager" << application.applicationVersion();
-    qCDebug(dcApplication()) << "=====================================";
-    qCDebug(dcApplication()) << "Advertising name:" << advertiseName;
-    qCDebug(dcApplication()) << "Platform name:" << platformName;
-    qCDebug(dcApplication()) << "Mode:" << mode;
-    qCDebug(dcApplication()) << "Timeout:" << timeout;
+    core.setConfigurationFile(configurationFileName, overrides);
+    core.applyConfiguration(configuration);
 
-    if (mode == Core::ModeButton && buttonGpio > 0)
-        qCDebug(dcApplication()) << QString("Button GPIO: %1 (Active %2)").arg(buttonGpio).arg(buttonActiveLow ? "low" : "high");
+    QObject::connect(&application, &Application::reloadRequested, &core, &Core::reloadConfiguration);
 
-    if (!dbusBusType.isEmpty() && dbusBusType != "none")
-        qCDebug(dcApplication()) << "DBus interface:" << dbusBusType;
+    core.run();
 
-    // Start core
-    Core core(&application);
-    core.setMode(mode);
-    core.setAdvertisingTimeout(timeout);
-    core.setAdvertiseName(advertiseName, forceFullName);
-    core.setPlatformName(platformName);
-    core.addGPioButton(buttonGpio, buttonActiveLow);
-
-    if (dbusBusType == "system") {
-        core.enableDBusInterface(QDBusConnection::SystemBus);
-    } else if (dbusBusType == "session") {
-        core.enableDBusInterface(QDBusConnection::SessionBus);
-    }
+    int result = application.exec();
 
-    core.run();
+    LoopWatchdog::instance()->stopWatching();
 
-    return application.exec();
+    // Everything logged after this point will be written synchronously
+    LogEngine::instance()->stopWriter();
+    return result;
 }
@@ -0,0 +1,144 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "memoryreport.h"
+
+#include <QFile>
+#include <QCoreApplication>
+#include <QXmlStreamReader>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
+QVariantMap MemoryReport::collect(const Subsystems &subsystems)
+{
+    QList<const QObject *> roots;
+    for (int i = 0; i < subsystems.count(); i++)
+        roots.append(subsystems.at(i).second);
+
+    QVariantMap objects;
+    for (int i = 0; i < subsystems.count(); i++) {
+        const QString &name = subsystems.at(i).first;
+        objects.insert(name, objects.value(name).toInt() + countObjects(subsystems.at(i).second, roots));
+    }
+
+    if (QCoreApplication::instance())
+        objects.insert("total", countObjects(QCoreApplication::instance(), QList<const QObject *>()));
+
+    QVariantMap report;
+    report.insert("rss", residentSetSize());
+    report.insert("heap", heapUsage());
+    report.insert("objects", objects);
+    return report;
+}
+
+qint64 MemoryReport::residentSetSize()
+{
+    // The second value is the resident set in pages
+    QFile statm("/proc/self/statm");
+    if (!statm.open(QIODevice::ReadOnly))
+        return -1;
+
+    QList<QByteArray> values = statm.readAll().split(' ');
+    if (values.count() < 2)
+        return -1;
+
+    return values.at(1).toLongLong() * sysconf(_SC_PAGESIZE);
+}
+
+QVariantMap MemoryReport::heapUsage()
+{
+    QVariantMap heap;
+
+#ifdef __GLIBC__
+    char *buffer = nullptr;
+    size_t size = 0;
+    FILE *stream = open_memstream(&buffer, &size);
+    if (!stream)
+        return heap;
+
+    int result = malloc_info(0, stream);
+    fclose(stream);
+    QByteArray xml(buffer, static_cast<int>(size));
+    free(buffer);
+    if (result != 0)
+        return heap;
+
+    // Only the totals over all arenas, which are the direct children of <malloc>
+    qint64 current = 0;
+    qint64 freeSize = 0;
+    qint64 mmap = 0;
+    int depth = 0;
+    QXmlStreamReader reader(xml);
+    while (!reader.atEnd()) {
+        reader.readNext();
+        if (reader.isEndElement()) {
+            depth--;
+            continue;
+        }
+
+        if (!reader.isStartElement() || ++depth != 2)
+            continue;
+
+        QString type = reader.attributes().value("type").toString();
+        qint64 value = reader.attributes().value("size").toString().toLongLong();
+        if (reader.name() == QLatin1String("system") && type == "current") {
+            current = value;
+        } else if (reader.name() == QLatin1String("total") && (type == "fast" || type == "rest")) {
+            freeSize += value;
+        } else if (reader.name() == QLatin1String("total") && type == "mmap") {
+            mmap = value;
+        }
+    }
+
+    heap.insert("size", current);
+    heap.insert("free", freeSize);
+    heap.insert("inUse", current - freeSize);
+    heap.insert("mmap", mmap);
+#endif
+
+    return heap;
+}
+
+int MemoryReport::countObjects(const QObject *object, const QList<const QObject *> &roots)
+{
+    if (!object)
+        return 0;
+
+    int count = 1;
+    foreach (const QObject *child, object->children()) {
+        if (roots.contains(child))
+            continue;
+
+        count += countObjects(child, roots);
+    }
+
+    return count;
+}
@@ -0,0 +1,52 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef MEMORYREPORT_H
+#define MEMORYREPORT_H
+
+#include <QPair>
+#include <QList>
+#include <QObject>
+#include <QVariantMap>
+
+// Snapshot of the memory used by the daemon: the resident set from the kernel, the heap
+// statistics of glibc and the number of live QObjects per subsystem. Objects of a
+// subsystem which is a child of another one are only counted for the inner subsystem.
+class MemoryReport
+{
+public:
+    typedef QList<QPair<QString, const QObject *>> Subsystems;
+
+    static QVariantMap collect(const Subsystems &subsystems);
+
+    static qint64 residentSetSize();
+    static QVariantMap heapUsage();
+
+private:
+    static int countObjects(const QObject *object, const QList<const QObject *> &roots);
+
+};
+
+#endif // MEMORYREPORT_H
@@ -0,0 +1,242 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "networkmanagerwatcher.h"
+#include "loopwatchdog.h"
+
+#include <QDBusVariant>
+#include <QDBusMessage>
+#include <QDBusConnection>
+#include <QLoggingCategory>
+#include <QDBusPendingReply>
+#include <QDBusConnectionInterface>
+
+Q_LOGGING_CATEGORY(dcNetworkManagerWatcher, "NetworkManagerWatcher")
+
+static const QString s_service = "org.freedesktop.NetworkManager";
+static const QString s_path = "/org/freedesktop/NetworkManager";
+static const QString s_settingsPath = "/org/freedesktop/NetworkManager/Settings";
+static const QString s_settingsInterface = "org.freedesktop.NetworkManager.Settings";
+static const QString s_propertiesInterface = "org.freedesktop.DBus.Properties";
+
+NetworkManagerWatcher::NetworkManagerWatcher(QObject *parent) :
+    QObject(parent)
+{
+
+}
+
+NetworkManagerWatcher::~NetworkManagerWatcher()
+{
+    unsubscribe();
+}
+
+bool NetworkManagerWatcher::available() const
+{
+    return m_available;
+}
+
+NetworkManager::NetworkManagerState NetworkManagerWatcher::state() const
+{
+    return m_state;
+}
+
+int NetworkManagerWatcher::connectionCount() const
+{
+    return m_connectionCount;
+}
+
+void NetworkManagerWatcher::start()
+{
+    if (!QDBusConnection::systemBus().isConnected()) {
+        qCWarning(dcNetworkManagerWatcher()) << "System DBus not connected.";
+        return;
+    }
+
+    m_serviceWatcher = new QDBusServiceWatcher(s_service, QDBusConnection::systemBus(), QDBusServiceWatcher::WatchForRegistration | QDBusServiceWatcher::WatchForUnregistration, this);
+    connect(m_serviceWatcher, &QDBusServiceWatcher::serviceRegistered, this, &NetworkManagerWatcher::serviceRegistered);
+    connect(m_serviceWatcher, &QDBusServiceWatcher::serviceUnregistered, this, &NetworkManagerWatcher::serviceUnregistered);
+
+    // Subscribe before loading the initial values, so no change gets lost in between
+    subscribe();
+
+    QDBusPendingCall call = QDBusConnection::systemBus().interface()->asyncCall("NameHasOwner", s_service);
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, &NetworkManagerWatcher::onNameHasOwnerFinished);
+}
+
+void NetworkManagerWatcher::subscribe()
+{
+    if (m_subscribed)
+        return;
+
+    // Each connect adds a match rule on the bus, only these signals get delivered to us
+    QDBusConnection::systemBus().connect(s_service, s_path, s_propertiesInterface, "PropertiesChanged", this, SLOT(onPropertiesChanged(QString,QVariantMap,QStringList)));
+    QDBusConnection::systemBus().connect(s_service, s_settingsPath, s_settingsInterface, "NewConnection", this, SLOT(onConnectionsChanged(QDBusObjectPath)));
+    QDBusConnection::systemBus().connect(s_service, s_settingsPath, s_settingsInterface, "ConnectionRemoved", this, SLOT(onConnectionsChanged(QDBusObjectPath)));
+    m_subscribed = true;
+}
+
+void NetworkManagerWatcher::unsubscribe()
+{
+    if (!m_subscribed)
+        return;
+
+    QDBusConnection::systemBus().disconnect(s_service, s_path, s_propertiesInterface, "PropertiesChanged", this, SLOT(onPropertiesChanged(QString,QVariantMap,QStringList)));
+    QDBusConnection::systemBus().disconnect(s_service, s_settingsPath, s_settingsInterface, "NewConnection", this, SLOT(onConnectionsChanged(QDBusObjectPath)));
+    QDBusConnection::systemBus().disconnect(s_service, s_settingsPath, s_settingsInterface, "ConnectionRemoved", this, SLOT(onConnectionsChanged(QDBusObjectPath)));
+    m_subscribed = false;
+}
+
+void NetworkManagerWatcher::loadState()
+{
+    QDBusMessage message = QDBusMessage::createMethodCall(s_service, s_path, s_propertiesInterface, "Get");
+    message << s_service << QString("State");
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::systemBus().asyncCall(message), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, &NetworkManagerWatcher::onStateFinished);
+}
+
+void NetworkManagerWatcher::loadConnections()
+{
+    QDBusMessage message = QDBusMessage::createMethodCall(s_service, s_settingsPath, s_settingsInterface, "ListConnections");
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(QDBusConnection::systemBus().asyncCall(message), this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, &NetworkManagerWatcher::onListConnectionsFinished);
+}
+
+void NetworkManagerWatcher::evaluateAvailable()
+{
+    bool available = m_stateLoaded && m_connectionsLoaded;
+    if (m_available == available)
+        return;
+
+    if (available) {
+        qCDebug(dcNetworkManagerWatcher()) << "Networkmanager is now available." << m_state << "with" << m_connectionCount << "network configurations";
+    } else {
+        qCWarning(dcNetworkManagerWatcher()) << "Networkmanager is not available any more.";
+    }
+
+    m_available = available;
+    emit availableChanged(m_available);
+}
+
+void NetworkManagerWatcher::setState(NetworkManager::NetworkManagerState state)
+{
+    if (m_stateLoaded && m_state == state)
+        return;
+
+    m_state = state;
+    m_stateLoaded = true;
+    if (m_available)
+        emit stateChanged(m_state);
+}
+
+void NetworkManagerWatcher::serviceRegistered(const QString &serviceName)
+{
+    WATCHDOG_SCOPE();
+    qCDebug(dcNetworkManagerWatcher()) << "Service registered" << serviceName;
+    loadState();
+    loadConnections();
+}
+
+void NetworkManagerWatcher::serviceUnregistered(const QString &serviceName)
+{
+    WATCHDOG_SCOPE();
+    qCDebug(dcNetworkManagerWatcher()) << "Service unregistered" << serviceName;
+    m_stateLoaded = false;
+    m_connectionsLoaded = false;
+    evaluateAvailable();
+}
+
+void NetworkManagerWatcher::onNameHasOwnerFinished(QDBusPendingCallWatcher *watcher)
+{
+    WATCHDOG_SCOPE();
+    QDBusPendingReply<bool> reply = *watcher;
+    watcher->deleteLater();
+
+    if (reply.isError()) {
+        qCWarning(dcNetworkManagerWatcher()) << "Could not check whether the networkmanager is running:" << reply.error().message();
+        return;
+    }
+
+    if (reply.value()) {
+        loadState();
+        loadConnections();
+    } else {
+        qCDebug(dcNetworkManagerWatcher()) << "Networkmanager is not running yet.";
+    }
+}
+
+void NetworkManagerWatcher::onStateFinished(QDBusPendingCallWatcher *watcher)
+{
+    WATCHDOG_SCOPE();
+    QDBusPendingReply<QDBusVariant> reply = *watcher;
+    watcher->deleteLater();
+
+    if (reply.isError()) {
+        qCWarning(dcNetworkManagerWatcher()) << "Could not get the networkmanager state:" << reply.error().message();
+        return;
+    }
+
+    // The values of the enum are the ones of NMState
+    setState(static_cast<NetworkManager::NetworkManagerState>(reply.value().variant().toUInt()));
+    evaluateAvailable();
+}
+
+void NetworkManagerWatcher::onListConnectionsFinished(QDBusPendingCallWatcher *watcher)
+{
+    WATCHDOG_SCOPE();
+    QDBusPendingReply<QList<QDBusObjectPath>> reply = *watcher;
+    watcher->deleteLater();
+
+    if (reply.isError()) {
+        qCWarning(dcNetworkManagerWatcher()) << "Could not list the network configurations:" << reply.error().message();
+        return;
+    }
+
+    if (m_available && reply.value().count() != m_connectionCount)
+        qCDebug(dcNetworkManagerWatcher()) << "There are now" << reply.value().count() << "network configurations";
+
+    m_connectionCount = reply.value().count();
+    m_connectionsLoaded = true;
+
+    evaluateAvailable();
+}
+
+void NetworkManagerWatcher::onPropertiesChanged(const QString &interface, const QVariantMap &changedProperties, const QStringList &invalidatedProperties)
+{
+    WATCHDOG_SCOPE();
+    Q_UNUSED(invalidatedProperties)
+    if (interface != s_service || !changedProperties.contains("State"))
+        return;
+
+    setState(static_cast<NetworkManager::NetworkManagerState>(changedProperties.value("State").toUInt()));
+}
+
+void NetworkManagerWatcher::onConnectionsChanged(const QDBusObjectPath &connection)
+{
+    WATCHDOG_SCOPE();
+    Q_UNUSED(connection)
+    // Only the number is of interest, the settings of the connections never get loaded
+    loadConnections();
+}
@@ -0,0 +1,86 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef NETWORKMANAGERWATCHER_H
+#define NETWORKMANAGERWATCHER_H
+
+#include <QObject>
+#include <QDBusObjectPath>
+#include <QLoggingCategory>
+#include <QDBusServiceWatcher>
+#include <QDBusPendingCallWatcher>
+
+#include <networkmanager.h>
+
+Q_DECLARE_LOGGING_CATEGORY(dcNetworkManagerWatcher)
+
+// Follows only the networkmanager state and the number of network configurations using
+// D-Bus signals, without mirroring the object tree the way NetworkManager::start() does.
+class NetworkManagerWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit NetworkManagerWatcher(QObject *parent = nullptr);
+    ~NetworkManagerWatcher();
+
+    bool available() const;
+    NetworkManager::NetworkManagerState state() const;
+    int connectionCount() const;
+
+    void start();
+
+private:
+    QDBusServiceWatcher *m_serviceWatcher = nullptr;
+    bool m_subscribed = false;
+
+    bool m_available = false;
+    bool m_stateLoaded = false;
+    bool m_connectionsLoaded = false;
+    NetworkManager::NetworkManagerState m_state = NetworkManager::NetworkManagerStateUnknown;
+    int m_connectionCount = 0;
+
+    void subscribe();
+    void unsubscribe();
+    void loadState();
+    void loadConnections();
+    void evaluateAvailable();
+    void setState(NetworkManager::NetworkManagerState state);
+
+signals:
+    void availableChanged(bool available);
+    void stateChanged(NetworkManager::NetworkManagerState state);
+
+private slots:
+    void serviceRegistered(const QString &serviceName);
+    void serviceUnregistered(const QString &serviceName);
+    void onNameHasOwnerFinished(QDBusPendingCallWatcher *watcher);
+    void onStateFinished(QDBusPendingCallWatcher *watcher);
+    void onListConnectionsFinished(QDBusPendingCallWatcher *watcher);
+    void onPropertiesChanged(const QString &interface, const QVariantMap &changedProperties, const QStringList &invalidatedProperties);
+    void onConnectionsChanged(const QDBusObjectPath &connection);
+
+};
+
+#endif // NETWORKMANAGERWATCHER_H
@@ -0,0 +1,135 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "networksnapshot.h"
+#include "core.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QJsonObject>
+#include <QJsonDocument>
+
+NetworkSnapshot::NetworkSnapshot()
+{
+
+}
+
+QString NetworkSnapshot::stateFile() const
+{
+    return m_stateFile;
+}
+
+void NetworkSnapshot::setStateFile(const QString &fileName)
+{
+    if (m_stateFile == fileName)
+        return;
+
+    m_stateFile = fileName;
+    load();
+}
+
+bool NetworkSnapshot::valid() const
+{
+    return m_valid;
+}
+
+int NetworkSnapshot::connectionCount() const
+{
+    return m_connectionCount;
+}
+
+void NetworkSnapshot::setConnectionCount(int connectionCount)
+{
+    if (m_valid && m_connectionCount == connectionCount)
+        return;
+
+    m_connectionCount = connectionCount;
+    m_valid = true;
+    save();
+}
+
+QString NetworkSnapshot::lastSsid() const
+{
+    return m_lastSsid;
+}
+
+bool NetworkSnapshot::provisioned() const
+{
+    return m_provisioned;
+}
+
+void NetworkSnapshot::setProvisioned(const QString &ssid)
+{
+    if (m_provisioned && m_lastSsid == ssid)
+        return;
+
+    m_provisioned = true;
+    m_lastSsid = ssid;
+    save();
+}
+
+void NetworkSnapshot::load()
+{
+    m_valid = false;
+    m_connectionCount = 0;
+    m_lastSsid.clear();
+    m_provisioned = false;
+
+    QFile file(m_stateFile);
+    if (m_stateFile.isEmpty() || !file.open(QIODevice::ReadOnly))
+        return;
+
+    QJsonParseError error;
+    QJsonObject snapshot = QJsonDocument::fromJson(file.readAll(), &error).object();
+    if (error.error != QJsonParseError::NoError || !snapshot.contains("connections")) {
+        qCWarning(dcApplication()) << "Ignoring invalid network snapshot in" << m_stateFile << error.errorString();
+        return;
+    }
+
+    m_valid = true;
+    m_connectionCount = snapshot.value("connections").toInt();
+    m_lastSsid = snapshot.value("lastSsid").toString();
+    m_provisioned = snapshot.value("provisioned").toBool();
+}
+
+void NetworkSnapshot::save()
+{
+    if (m_stateFile.isEmpty())
+        return;
+
+    QDir().mkpath(QFileInfo(m_stateFile).absolutePath());
+
+    QJsonObject snapshot;
+    snapshot.insert("connections", m_connectionCount);
+    snapshot.insert("lastSsid", m_lastSsid);
+    snapshot.insert("provisioned", m_provisioned);
+
+    QSaveFile file(m_stateFile);
+    if (!file.open(QIODevice::WriteOnly) || file.write(QJsonDocument(snapshot).toJson(QJsonDocument::Compact)) < 0 || !file.commit()) {
+        qCWarning(dcApplication()) << "Could not save the network snapshot to" << m_stateFile << file.errorString();
+    }
+}
@@ -0,0 +1,62 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef NETWORKSNAPSHOT_H
+#define NETWORKSNAPSHOT_H
+
+#include <QString>
+
+// The facts about the network configuration which decide whether to advertise at all,
+// kept in a small state file so they are known before the networkmanager is loaded.
+class NetworkSnapshot
+{
+public:
+    NetworkSnapshot();
+
+    QString stateFile() const;
+    void setStateFile(const QString &fileName);
+
+    bool valid() const;
+
+    int connectionCount() const;
+    void setConnectionCount(int connectionCount);
+
+    QString lastSsid() const;
+    bool provisioned() const;
+    void setProvisioned(const QString &ssid);
+
+private:
+    QString m_stateFile;
+    bool m_valid = false;
+    int m_connectionCount = 0;
+    QString m_lastSsid;
+    bool m_provisioned = false;
+
+    void load();
+    void save();
+
+};
+
+#endif // NETWORKSNAPSHOT_H
@@ -15,30 +15,14 @@ greaterThan(QT_MAJOR_VERSION, 5) {
     DEFINES += QT_DISABLE_DEPRECATED_UP_TO=0x050F00
 }
 
-QT += core network bluetooth dbus
-QT -= gui
+include(sources.pri)
 
-CONFIG += console link_pkgconfig
+CONFIG += console
 CONFIG -= app_bundle
 
 TEMPLATE = app
-PKGCONFIG += nymea-networkmanager nymea-gpio
 
-HEADERS += \
-    application.h \
-    core.h \
-    nymeadservice.h \
-    nymeanetworkmanagerdbusservice.h \
-    pushbuttonagent.h \
-
-
-SOURCES += \
-    main.cpp \
-    application.cpp \
-    core.cpp \
-    nymeadservice.cpp \
-    nymeanetworkmanagerdbusservice.cpp \
-    pushbuttonagent.cpp \
+SOURCES += main.cpp
 
 target.path = /usr/bin
 INSTALLS += target
@@ -0,0 +1,42 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#ifndef NYMEADPROXY_H
+#define NYMEADPROXY_H
+
+#include <QObject>
+#include <QDBusConnection>
+#include <QDBusAbstractInterface>
+
+// Static proxy for a nymead D-Bus object. Unlike QDBusInterface this does not
+// introspect the remote object on construction, which would be a blocking round trip.
+class NymeadProxy : public QDBusAbstractInterface
+{
+    Q_OBJECT
+public:
+    explicit NymeadProxy(const QString &path, const QDBusConnection &connection, QObject *parent = nullptr);
+
+};
+
+#endif // NYMEADPROXY_H
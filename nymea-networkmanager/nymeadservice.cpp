@@ -23,8 +23,11 @@
 * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include "nymeadservice.h"
+#include "loopwatchdog.h"
 
 #include <QLoggingCategory>
+#include <QDBusPendingReply>
+#include <QDBusConnectionInterface>
 
 Q_LOGGING_CATEGORY(dcNymeaService, "NymeaService")
 
@@ -43,18 +46,24 @@ NymeadService::NymeadService(bool pushbuttonEnabled, QObject *parent) :
     connect(m_serviceWatcher, &QDBusServiceWatcher::serviceRegistered, this, &NymeadService::serviceRegistered);
     connect(m_serviceWatcher, &QDBusServiceWatcher::serviceUnregistered, this, &NymeadService::serviceUnregistered);
 
-    if (init()) {
-        qCDebug(dcNymeaService()) << "Initialized nymea D-Bus services successfully";
-    } else {
-        qCWarning(dcNymeaService()) << "Could not init nymea D-Bus services";
-        setAvailable(false);
-    }
+    // Ask the bus asynchronously whether nymead is already running instead of
+    // introspecting its objects, the proxies will be created once they are needed.
+    QDBusPendingCall call = QDBusConnection::systemBus().interface()->asyncCall("NameHasOwner", QString("io.guh.nymead"));
+    QDBusPendingCallWatcher *watcher = new QDBusPendingCallWatcher(call, this);
+    connect(watcher, &QDBusPendingCallWatcher::finished, this, &NymeadService::onNameHasOwnerFinished);
 }
 
 NymeadService::~NymeadService()
 {
-    // Note: re-enable bluetooth hardware resource on nymea
-    enableBluetooth(true);
+    // Note: re-enable bluetooth hardware resource on nymea. There is no event loop
+    // any more to deliver an asynchronous reply, so this is the only blocking call.
+    if (m_nymeadHardwareBluetoothInterface) {
+        m_nymeadHardwareBluetoothInterface->setTimeout(m_callTimeout);
+        QDBusMessage query = m_nymeadHardwareBluetoothInterface->call("EnableBluetooth", true);
+        if (query.type() != QDBusMessage::ReplyMessage) {
+            qCWarning(dcNymeaService()) << "Could not re-enable bluetooth on dbus:" << query.errorName() << query.errorMessage();
+        }
+    }
 }
 
 bool NymeadService::available() const
@@ -62,20 +71,33 @@ bool NymeadService::available() const
     return m_available;
 }
 
+int NymeadService::callTimeout() const
+{
+    return m_callTimeout;
+}
+
+void NymeadService::setCallTimeout(int callTimeout)
+{
+    m_callTimeout = callTimeout;
+}
+
 void NymeadService::enableBluetooth(bool enable)
 {
-    if (!m_nymeadHardwareBluetoothInterface) {
+    if (!m_available) {
         qCDebug(dcNymeaService()) << "Could not enable/disable bluetooth hardware resource. D-Bus interface not available.";
         return;
     }
 
-    qCDebug(dcNymeaService()) << "Request nymea to" << (enable ? "enable" : "disable") << "bluetooth resources";
+    m_enableBluetoothRequested = enable;
 
-    QDBusMessage query = m_nymeadHardwareBluetoothInterface->call("EnableBluetooth", enable);
-    if(query.type() != QDBusMessage::ReplyMessage) {
-        qCWarning(dcNymeaService()) << "Could not enable/disable bluetooth on dbus:" << query.errorName() << query.errorMessage();
+    // Coalesce: while a call is pending only the latest requested state will be sent afterwards
+    if (m_enableBluetoothWatcher) {
+        qCDebug(dcNymeaService()) << "EnableBluetooth call still pending. Queue request to" << (enable ? "enable" : "disable") << "bluetooth resources";
+        m_enableBluetoothQueued = true;
         return;
     }
+
+    sendEnableBluetooth(enable);
 }
 
 void NymeadService::pushButtonPressed()
@@ -89,6 +111,28 @@ void NymeadService::pushButtonPressed()
     m_pushButtonAgent->sendButtonPressed();
 }
 
+void NymeadService::sendEnableBluetooth(bool enable)
+{
+    qCDebug(dcNymeaService()) << "Request nymea to" << (enable ? "enable" : "disable") << "bluetooth resources";
+
+    m_enableBluetoothSent = enable;
+    NymeadProxy *bluetoothInterface = hardwareBluetoothInterface();
+    bluetoothInterface->setTimeout(m_callTimeout);
+    QDBusPendingCall call = bluetoothInterface->asyncCall("EnableBluetooth", enable);
+    m_enableBluetoothWatcher = new QDBusPendingCallWatcher(call, this);
+    connect(m_enableBluetoothWatcher, &QDBusPendingCallWatcher::finished, this, &NymeadService::onEnableBluetoothFinished);
+}
+
+NymeadProxy *NymeadService::hardwareBluetoothInterface()
+{
+    if (!m_nymeadHardwareBluetoothInterface) {
+        qCDebug(dcNymeaService()) << "Creating D-Bus proxy for the HardwareManager BluetoothLE interface";
+        m_nymeadHardwareBluetoothInterface = new NymeadProxy("/io/guh/nymead/HardwareManager/BluetoothLEManager", QDBusConnection::systemBus(), this);
+    }
+
+    return m_nymeadHardwareBluetoothInterface;
+}
+
 void NymeadService::setAvailable(const bool &available)
 {
     if (m_available == available)
@@ -116,28 +160,13 @@ bool NymeadService::init()
         }
     }
 
-    m_nymeadHardwareInterface = new QDBusInterface("io.guh.nymead", "/io/guh/nymead/HardwareManager", "io.guh.nymead", QDBusConnection::systemBus(), this);
-    if (!m_nymeadHardwareInterface->isValid()) {
-        qCWarning(dcNymeaService()) << "Invalid D-Bus HardwareManager interface.";
-        m_nymeadHardwareInterface->deleteLater();
-        m_nymeadHardwareInterface = nullptr;
-        return false;
-    }
-
-    m_nymeadHardwareBluetoothInterface = new QDBusInterface("io.guh.nymead", "/io/guh/nymead/HardwareManager/BluetoothLEManager", "io.guh.nymead", QDBusConnection::systemBus(), this);
-    if (!m_nymeadHardwareBluetoothInterface->isValid()) {
-        qCWarning(dcNymeaService()) << "Invalid D-Bus HardwareManager BluetoothLE interface.";
-        m_nymeadHardwareBluetoothInterface->deleteLater();
-        m_nymeadHardwareBluetoothInterface = nullptr;
-        return false;
-    }
-
     setAvailable(true);
     return true;
 }
 
 void NymeadService::serviceRegistered(const QString &serviceName)
 {
+    WATCHDOG_SCOPE();
     qCDebug(dcNymeaService()) << "Service registered" << serviceName;
     if (!m_available) {
         init();
@@ -146,6 +175,7 @@ void NymeadService::serviceRegistered(const QString &serviceName)
 
 void NymeadService::serviceUnregistered(const QString &serviceName)
 {
+    WATCHDOG_SCOPE();
     qCDebug(dcNymeaService()) << "Service unregistered" << serviceName;
 
     if (m_pushButtonAgent) {
@@ -153,15 +183,63 @@ void NymeadService::serviceUnregistered(const QString &serviceName)
         m_pushButtonAgent = nullptr;
     }
 
-    if (m_nymeadHardwareInterface) {
-        m_nymeadHardwareInterface->deleteLater();
-        m_nymeadHardwareInterface = nullptr;
-    }
-
     if (m_nymeadHardwareBluetoothInterface) {
         m_nymeadHardwareBluetoothInterface->deleteLater();
         m_nymeadHardwareBluetoothInterface = nullptr;
     }
 
+    // A pending reply will fail anyways, there is nobody to send the queued request to
+    m_enableBluetoothQueued = false;
+
     setAvailable(false);
 }
+
+void NymeadService::onNameHasOwnerFinished(QDBusPendingCallWatcher *watcher)
+{
+    WATCHDOG_SCOPE();
+    QDBusPendingReply<bool> reply = *watcher;
+    watcher->deleteLater();
+
+    if (reply.isError()) {
+        qCWarning(dcNymeaService()) << "Could not check if nymead is running:" << reply.error().message();
+        return;
+    }
+
+    if (!reply.value()) {
+        qCDebug(dcNymeaService()) << "nymead is not running yet. Waiting for the service to appear.";
+        return;
+    }
+
+    if (!m_available) {
+        if (init()) {
+            qCDebug(dcNymeaService()) << "Initialized nymea D-Bus services successfully";
+        } else {
+            qCWarning(dcNymeaService()) << "Could not init nymea D-Bus services";
+        }
+    }
+}
+
+void NymeadService::onEnableBluetoothFinished(QDBusPendingCallWatcher *watcher)
+{
+    WATCHDOG_SCOPE();
+    QDBusPendingReply<> reply = *watcher;
+    watcher->deleteLater();
+    if (watcher == m_enableBluetoothWatcher)
+        m_enableBluetoothWatcher = nullptr;
+
+    bool success = !reply.isError();
+    if (!success) {
+        qCWarning(dcNymeaService()) << "Could not" << (m_enableBluetoothSent ? "enable" : "disable") << "bluetooth on dbus:" << reply.error().name() << reply.error().message();
+    }
+
+    if (m_enableBluetoothQueued && m_available) {
+        m_enableBluetoothQueued = false;
+        if (m_enableBluetoothRequested != m_enableBluetoothSent || !success) {
+            sendEnableBluetooth(m_enableBluetoothRequested);
+            return;
+        }
+    }
+
+    qCDebug(dcNymeaService()) << "Bluetooth resources" << (m_enableBluetoothSent ? "enabled" : "disabled") << "on nymea" << (success ? "successfully" : "with errors");
+    emit enableBluetoothFinished(m_enableBluetoothSent, success);
+}
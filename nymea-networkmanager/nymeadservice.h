@@ -26,10 +26,11 @@
 #define NYMEADSERVICE_H
 
 #include <QObject>
-#include <QDBusInterface>
 #include <QDBusConnection>
 #include <QDBusServiceWatcher>
+#include <QDBusPendingCallWatcher>
 
+#include "nymeadproxy.h"
 #include "pushbuttonagent.h"
 
 class NymeadService : public QObject
@@ -40,6 +41,9 @@ public:
     ~NymeadService();
     bool available() const;
 
+    int callTimeout() const;
+    void setCallTimeout(int callTimeout);
+
     void enableBluetooth(bool enable);
     void pushButtonPressed();
 
@@ -47,22 +51,34 @@ private:
     QDBusServiceWatcher *m_serviceWatcher = nullptr;
     PushButtonAgent *m_pushButtonAgent = nullptr;
 
-    QDBusInterface *m_nymeadHardwareInterface = nullptr;
-    QDBusInterface *m_nymeadHardwareBluetoothInterface = nullptr;
+    // Created lazily on first use
+    NymeadProxy *m_nymeadHardwareBluetoothInterface = nullptr;
+
+    // Only one EnableBluetooth call is in flight, newer requests replace the queued one
+    QDBusPendingCallWatcher *m_enableBluetoothWatcher = nullptr;
+    bool m_enableBluetoothSent = true;
+    bool m_enableBluetoothRequested = true;
+    bool m_enableBluetoothQueued = false;
 
     bool m_pushbuttonEnabled = false;
     bool m_available = false;
+    int m_callTimeout = 5000;
 
     void setAvailable(const bool &available);
+    void sendEnableBluetooth(bool enable);
+    NymeadProxy *hardwareBluetoothInterface();
 
     bool init();
 
 signals:
     void availableChanged(const bool &available);
+    void enableBluetoothFinished(bool enable, bool success);
 
 private slots:
     void serviceRegistered(const QString &serviceName);
     void serviceUnregistered(const QString &serviceName);
+    void onNameHasOwnerFinished(QDBusPendingCallWatcher *watcher);
+    void onEnableBluetoothFinished(QDBusPendingCallWatcher *watcher);
 
 };
 
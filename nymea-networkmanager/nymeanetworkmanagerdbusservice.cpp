@@ -23,20 +23,32 @@
 * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
 
 #include "nymeanetworkmanagerdbusservice.h"
+#include "logengine.h"
+#include "loopwatchdog.h"
+#include "core.h"
+#include "configuration.h"
 
+#include <QMetaEnum>
+#include <QDBusMessage>
 #include <QLoggingCategory>
 
 Q_LOGGING_CATEGORY(dcDBus, "DBus");
 
-NymeaNetworkManagerDBusService::NymeaNetworkManagerDBusService(QDBusConnection::BusType busType, QObject *parent) : QObject(parent),
-    m_connection(busType == QDBusConnection::SystemBus ? QDBusConnection::systemBus() : QDBusConnection::sessionBus())
+NymeaNetworkManagerDBusService::NymeaNetworkManagerDBusService(QDBusConnection::BusType busType, Core *core) : QObject(core),
+    m_connection(busType == QDBusConnection::SystemBus ? QDBusConnection::systemBus() : QDBusConnection::sessionBus()),
+    m_core(core)
 {
+    changedProperties();
+    connect(m_core, &Core::serverStateChanged, this, &NymeaNetworkManagerDBusService::onServerStateChanged);
+    connect(m_core, &Core::modeChanged, this, &NymeaNetworkManagerDBusService::onPropertyChanged);
+    connect(m_core, &Core::networkManagerStateChanged, this, &NymeaNetworkManagerDBusService::onPropertyChanged);
+
     bool status = m_connection.registerService("io.nymea.networkmanager");
     if (!status) {
         qCWarning(dcDBus()) << "Failed to register D-Bus service.";
         return;
     }
-    status = m_connection.registerObject("/io/nymea/networkmanager", "io.nymea.networkmanager", this, QDBusConnection::ExportScriptableSlots);
+    status = m_connection.registerObject("/io/nymea/networkmanager", "io.nymea.networkmanager", this, QDBusConnection::ExportScriptableSlots | QDBusConnection::ExportScriptableProperties);
     if (!status) {
         qCWarning(dcDBus()) << "Failed to register D-Bus object.";
         return;
@@ -44,6 +56,31 @@ NymeaNetworkManagerDBusService::NymeaNetworkManagerDBusService(QDBusConnection::
     qCDebug(dcDBus()) << "Registered DBus interface";
 }
 
+bool NymeaNetworkManagerDBusService::running() const
+{
+    return m_core->bluetoothServer() && m_core->bluetoothServer()->running();
+}
+
+bool NymeaNetworkManagerDBusService::connected() const
+{
+    return m_core->state() == Core::StateConnected;
+}
+
+QString NymeaNetworkManagerDBusService::mode() const
+{
+    return QMetaEnum::fromType<Core::Mode>().valueToKey(m_core->mode());
+}
+
+int NymeaNetworkManagerDBusService::remainingAdvertisingTime() const
+{
+    return m_core->remainingAdvertisingTime();
+}
+
+QString NymeaNetworkManagerDBusService::networkManagerState() const
+{
+    return QMetaEnum::fromType<NetworkManager::NetworkManagerState>().valueToKey(m_core->networkManagerState());
+}
+
 void NymeaNetworkManagerDBusService::enableBluetoothServer()
 {
     qCDebug(dcDBus()) << "Enable bluetooth server called";
@@ -61,3 +98,172 @@ void NymeaNetworkManagerDBusService::stopBluetoothServer()
     qCDebug(dcDBus()) << "Stop bluetooth server requested";
     emit stopBluetoothServerRequested();
 }
+
+QVariantMap NymeaNetworkManagerDBusService::requestStart(int timeout)
+{
+    uint requestId = ++m_requestId;
+    qCDebug(dcDBus()) << "Start request" << requestId << "with a timeout of" << timeout << "seconds";
+    return requestReply(requestId, m_core->requestStart(timeout));
+}
+
+QVariantMap NymeaNetworkManagerDBusService::requestStop()
+{
+    uint requestId = ++m_requestId;
+    qCDebug(dcDBus()) << "Stop request" << requestId;
+    return requestReply(requestId, m_core->requestStop());
+}
+
+QVariantMap NymeaNetworkManagerDBusService::applyBatch(const QStringList &operations)
+{
+    uint requestId = ++m_requestId;
+    qCDebug(dcDBus()) << "Batch request" << requestId << operations;
+
+    // The operations are executed in order, the batch stops at the first invalid one
+    QStringList results;
+    foreach (const QString &operation, operations) {
+        QString name = operation.section('=', 0, 0).trimmed();
+        QString value = operation.section('=', 1).trimmed();
+
+        Core::RequestResult result = Core::RequestResultInvalid;
+        if (name.toLower() == "start") {
+            bool valueOk = true;
+            int timeout = value.isEmpty() ? 0 : value.toInt(&valueOk);
+            if (valueOk)
+                result = m_core->requestStart(timeout);
+        } else if (name.toLower() == "stop" && value.isEmpty()) {
+            result = m_core->requestStop();
+        } else if (!name.isEmpty() && operation.contains('=')) {
+            if (!runtimeKey(name)) {
+                qCWarning(dcDBus()) << "The configuration key" << name << "can not be changed over D-Bus";
+            } else {
+                QVariantMap overrides;
+                overrides.insert(name, value);
+                if (m_core->applyOverrides(overrides))
+                    result = Core::RequestResultAccepted;
+            }
+        }
+
+        results.append(QMetaEnum::fromType<Core::RequestResult>().valueToKey(result));
+        if (result == Core::RequestResultInvalid) {
+            qCWarning(dcDBus()) << "Batch request" << requestId << "stopped at the invalid operation" << operation;
+            break;
+        }
+    }
+
+    QVariantMap reply;
+    reply.insert("requestId", requestId);
+    reply.insert("results", results);
+    return reply;
+}
+
+bool NymeaNetworkManagerDBusService::runtimeKey(const QString &name)
+{
+    // Keys about the hardware and the system integration are only taken from the configuration file
+    const Configuration::Key *key = Configuration::findKey(name);
+    return key && (key->flags & Configuration::FlagRuntime);
+}
+
+QVariantMap NymeaNetworkManagerDBusService::requestReply(uint requestId, Core::RequestResult result) const
+{
+    qCDebug(dcDBus()) << "Request" << requestId << "finished with" << result;
+
+    QVariantMap reply;
+    reply.insert("requestId", requestId);
+    reply.insert("result", QMetaEnum::fromType<Core::RequestResult>().valueToKey(result));
+    return reply;
+}
+
+bool NymeaNetworkManagerDBusService::reloadConfiguration()
+{
+    qCDebug(dcDBus()) << "Reload configuration requested";
+    return m_core->reloadConfiguration();
+}
+
+QVariantMap NymeaNetworkManagerDBusService::getMetrics()
+{
+    qCDebug(dcDBus()) << "Provisioning metrics requested";
+    QVariantMap metrics = m_core->metrics().toVariantMap();
+    metrics.insert("state", QMetaEnum::fromType<Core::State>().valueToKey(m_core->state()));
+    metrics.insert("transitions", m_core->transitionHistory());
+    metrics.insert("sessions", m_core->sessionHistory());
+    metrics.insert("watchdog", LoopWatchdog::instance()->toVariantMap());
+
+    QVariantMap adaptiveTimeout = m_core->adaptiveTimeout().toVariantMap();
+    adaptiveTimeout.insert("policy", QMetaEnum::fromType<Core::TimeoutPolicy>().valueToKey(m_core->timeoutPolicy()));
+    metrics.insert("adaptiveTimeout", adaptiveTimeout);
+    return metrics;
+}
+
+QVariantMap NymeaNetworkManagerDBusService::getMemoryReport()
+{
+    qCDebug(dcDBus()) << "Memory report requested";
+    return m_core->memoryReport();
+}
+
+QVariantMap NymeaNetworkManagerDBusService::loggingCategories()
+{
+    QVariantMap categories;
+    QHash<QString, bool> loggingFilters = LogEngine::instance()->loggingFilters();
+    foreach (const QString &category, loggingFilters.keys()) {
+        categories.insert(category, loggingFilters.value(category));
+    }
+    return categories;
+}
+
+bool NymeaNetworkManagerDBusService::setLoggingCategoryEnabled(const QString &category, bool enabled)
+{
+    if (category.isEmpty()) {
+        qCWarning(dcDBus()) << "Cannot change debug output of an empty logging category";
+        return false;
+    }
+
+    qCDebug(dcDBus()) << (enabled ? "Enable" : "Disable") << "debug output for logging category" << category;
+    LogEngine::instance()->setLoggingFilter(category, enabled);
+    LogEngine::instance()->installLoggingFilter();
+    return true;
+}
+
+QVariantMap NymeaNetworkManagerDBusService::changedProperties()
+{
+    QVariantMap properties;
+    properties.insert("Running", running());
+    properties.insert("Connected", connected());
+    properties.insert("Mode", mode());
+    properties.insert("NetworkManagerState", networkManagerState());
+
+    QVariantMap changedProperties;
+    foreach (const QString &name, properties.keys()) {
+        if (m_properties.value(name) != properties.value(name))
+            changedProperties.insert(name, properties.value(name));
+    }
+
+    m_properties = properties;
+    return changedProperties;
+}
+
+void NymeaNetworkManagerDBusService::sendPropertiesChanged(const QVariantMap &changedProperties)
+{
+    if (changedProperties.isEmpty())
+        return;
+
+    QDBusMessage message = QDBusMessage::createSignal("/io/nymea/networkmanager", "org.freedesktop.DBus.Properties", "PropertiesChanged");
+    message << QString("io.nymea.networkmanager") << changedProperties << QStringList();
+    if (!m_connection.send(message)) {
+        qCWarning(dcDBus()) << "Failed to send PropertiesChanged for" << changedProperties.keys();
+    }
+}
+
+void NymeaNetworkManagerDBusService::onServerStateChanged()
+{
+    WATCHDOG_SCOPE();
+    // The remaining time counts down on its own, it only gets sent whenever the advertising timer may have been restarted
+    QVariantMap properties = changedProperties();
+    properties.insert("RemainingAdvertisingTime", remainingAdvertisingTime());
+    sendPropertiesChanged(properties);
+}
+
+void NymeaNetworkManagerDBusService::onPropertyChanged()
+{
+    WATCHDOG_SCOPE();
+    sendPropertiesChanged(changedProperties());
+}
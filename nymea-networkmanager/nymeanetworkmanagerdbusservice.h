@@ -26,13 +26,28 @@
 #define NYMEANETWORKMANAGERDBUSSERVICE_H
 
 #include <QObject>
+#include <QVariantMap>
 #include <QDBusConnection>
 
+#include "core.h"
+
 class NymeaNetworkManagerDBusService : public QObject
 {
     Q_OBJECT
+    Q_PROPERTY(bool Running READ running)
+    Q_PROPERTY(bool Connected READ connected)
+    Q_PROPERTY(QString Mode READ mode)
+    Q_PROPERTY(int RemainingAdvertisingTime READ remainingAdvertisingTime)
+    Q_PROPERTY(QString NetworkManagerState READ networkManagerState)
+
 public:
-    explicit NymeaNetworkManagerDBusService(QDBusConnection::BusType busType, QObject *parent = nullptr);
+    explicit NymeaNetworkManagerDBusService(QDBusConnection::BusType busType, Core *core);
+
+    bool running() const;
+    bool connected() const;
+    QString mode() const;
+    int remainingAdvertisingTime() const;
+    QString networkManagerState() const;
 
 public slots:
     Q_SCRIPTABLE void enableBluetoothServer(); // Deprecated
@@ -40,6 +55,19 @@ public slots:
     Q_SCRIPTABLE void startBluetoothServer();
     Q_SCRIPTABLE void stopBluetoothServer();
 
+    // Return the request id and the result of the request
+    Q_SCRIPTABLE QVariantMap requestStart(int timeout);
+    Q_SCRIPTABLE QVariantMap requestStop();
+    Q_SCRIPTABLE QVariantMap applyBatch(const QStringList &operations);
+
+    Q_SCRIPTABLE bool reloadConfiguration();
+
+    Q_SCRIPTABLE QVariantMap getMetrics();
+    Q_SCRIPTABLE QVariantMap getMemoryReport();
+
+    Q_SCRIPTABLE QVariantMap loggingCategories();
+    Q_SCRIPTABLE bool setLoggingCategoryEnabled(const QString &category, bool enabled);
+
 signals:
     void enableBluetoothServerCalled();
     void startBluetoothServerRequested();
@@ -47,6 +75,22 @@ signals:
 
 private:
     QDBusConnection m_connection;
+    Core *m_core = nullptr;
+
+    // The values last sent with PropertiesChanged
+    QVariantMap m_properties;
+
+    uint m_requestId = 0;
+
+    QVariantMap requestReply(uint requestId, Core::RequestResult result) const;
+    static bool runtimeKey(const QString &name);
+
+    QVariantMap changedProperties();
+    void sendPropertiesChanged(const QVariantMap &changedProperties);
+
+private slots:
+    void onServerStateChanged();
+    void onPropertyChanged();
 
 };
 
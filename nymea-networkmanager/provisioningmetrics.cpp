@@ -0,0 +1,106 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#include "provisioningmetrics.h"
+
+#include <QMetaEnum>
+
+ProvisioningMetrics::ProvisioningMetrics()
+{
+    m_clock.start();
+    for (int i = 0; i < s_phaseCount; i++) {
+        m_phaseStarted[i] = -1;
+    }
+
+    for (int i = 0; i < s_counterCount; i++) {
+        m_counters[i] = 0;
+    }
+}
+
+void ProvisioningMetrics::begin(Phase phase)
+{
+    m_phaseStarted[phase] = m_clock.elapsed();
+}
+
+qint64 ProvisioningMetrics::end(Phase phase)
+{
+    // Ignore phases which have not been started, i.e. a client connected after a restart of the networkmanager
+    if (m_phaseStarted[phase] < 0)
+        return -1;
+
+    qint64 duration = m_clock.elapsed() - m_phaseStarted[phase];
+    m_histograms[phase].record(duration);
+    m_phaseStarted[phase] = -1;
+    return duration;
+}
+
+void ProvisioningMetrics::cancel(Phase phase)
+{
+    m_phaseStarted[phase] = -1;
+}
+
+void ProvisioningMetrics::increment(Counter counter)
+{
+    m_counters[counter]++;
+}
+
+quint64 ProvisioningMetrics::count(Counter counter) const
+{
+    return m_counters[counter];
+}
+
+const LatencyHistogram &ProvisioningMetrics::histogram(Phase phase) const
+{
+    return m_histograms[phase];
+}
+
+QVariantMap ProvisioningMetrics::toVariantMap() const
+{
+    QMetaEnum phaseEnum = QMetaEnum::fromType<Phase>();
+
+    QVariantMap phases;
+    for (int i = 0; i < s_phaseCount; i++) {
+        // Strip the "Phase" prefix
+        QString name = QString(phaseEnum.valueToKey(i)).mid(5);
+        name[0] = name.at(0).toLower();
+        phases.insert(name, m_histograms[i].toVariantMap());
+    }
+
+    QMetaEnum counterEnum = QMetaEnum::fromType<Counter>();
+
+    QVariantMap counters;
+    for (int i = 0; i < s_counterCount; i++) {
+        // Strip the "Counter" prefix
+        QString name = QString(counterEnum.valueToKey(i)).mid(7);
+        name[0] = name.at(0).toLower();
+        counters.insert(name, m_counters[i]);
+    }
+
+    QVariantMap metrics;
+    metrics.insert("uptime", m_clock.elapsed());
+    metrics.insert("phases", phases);
+    metrics.insert("counters", counters);
+    return metrics;
+}
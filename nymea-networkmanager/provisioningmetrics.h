@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+
+#ifndef PROVISIONINGMETRICS_H
+#define PROVISIONINGMETRICS_H
+
+#include <QObject>
+#include <QVariantMap>
+#include <QElapsedTimer>
+
+#include "latencyhistogram.h"
+
+// Measures the duration of each provisioning phase using a monotonic clock
+class ProvisioningMetrics
+{
+    Q_GADGET
+public:
+    enum Phase {
+        PhaseNetworkManagerAvailable,   // Core::run() or networkmanager lost -> available
+        PhaseBluetoothServerStart,      // start requested -> server running
+        PhaseClientConnect,             // server running -> client connected
+        PhaseWirelessConnect,           // client connected -> NetworkManagerStateConnectedGlobal
+        PhaseBluetoothServerStop,       // stop requested -> server stopped
+        PhaseNetworkManagerLoad         // object tree requested -> available, only while watching the networkmanager
+    };
+    Q_ENUM(Phase)
+
+    enum Counter {
+        CounterSuppressedStateChanges,  // networkmanager state changes coalesced by the offline debounce
+        CounterWirelessScans,           // background scans refreshing the access point list
+        CounterPrewarms                 // bluetooth server prepared within the offline debounce window
+    };
+    Q_ENUM(Counter)
+
+    ProvisioningMetrics();
+
+    void begin(Phase phase);
+    qint64 end(Phase phase);
+    void cancel(Phase phase);
+
+    void increment(Counter counter);
+    quint64 count(Counter counter) const;
+
+    const LatencyHistogram &histogram(Phase phase) const;
+
+    QVariantMap toVariantMap() const;
+
+private:
+    static const int s_phaseCount = PhaseNetworkManagerLoad + 1;
+    static const int s_counterCount = CounterPrewarms + 1;
+
+    QElapsedTimer m_clock;
+    qint64 m_phaseStarted[s_phaseCount];
+    LatencyHistogram m_histograms[s_phaseCount];
+    quint64 m_counters[s_counterCount];
+
+};
+
+#endif // PROVISIONINGMETRICS_H
@@ -0,0 +1,54 @@
+# The daemon without main.cpp, shared with the tests
+
+QT += core network bluetooth dbus
+QT -= gui
+
+CONFIG += link_pkgconfig
+
+# The service is Type=notify with a watchdog, systemd support is not optional
+PKGCONFIG += nymea-networkmanager nymea-gpio libsystemd
+
+# Only create the subsystems the configured mode needs (qmake CONFIG+=lazy_subsystems)
+lazy_subsystems {
+    message("Building with lazy subsystem creation")
+    DEFINES += WITH_LAZY_SUBSYSTEMS
+}
+
+INCLUDEPATH += $$PWD
+
+HEADERS += \
+    $$PWD/adaptivetimeout.h \
+    $$PWD/application.h \
+    $$PWD/configuration.h \
+    $$PWD/core.h \
+    $$PWD/gpioinputengine.h \
+    $$PWD/latencyhistogram.h \
+    $$PWD/logengine.h \
+    $$PWD/loopwatchdog.h \
+    $$PWD/memoryreport.h \
+    $$PWD/networkmanagerwatcher.h \
+    $$PWD/networksnapshot.h \
+    $$PWD/nymeadservice.h \
+    $$PWD/nymeadproxy.h \
+    $$PWD/nymeanetworkmanagerdbusservice.h \
+    $$PWD/provisioningmetrics.h \
+    $$PWD/pushbuttonagent.h \
+
+
+SOURCES += \
+    $$PWD/adaptivetimeout.cpp \
+    $$PWD/application.cpp \
+    $$PWD/configuration.cpp \
+    $$PWD/core.cpp \
+    $$PWD/gpioinputengine.cpp \
+    $$PWD/latencyhistogram.cpp \
+    $$PWD/logengine.cpp \
+    $$PWD/loopwatchdog.cpp \
+    $$PWD/memoryreport.cpp \
+    $$PWD/networkmanagerwatcher.cpp \
+    $$PWD/networksnapshot.cpp \
+    $$PWD/nymeadservice.cpp \
+    $$PWD/nymeadproxy.cpp \
+    $$PWD/nymeanetworkmanagerdbusservice.cpp \
+    $$PWD/provisioningmetrics.cpp \
+    $$PWD/pushbuttonagent.cpp \
@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <QtTest>
+#include <QTemporaryDir>
+
+#include "adaptivetimeout.h"
+
+class TestAdaptiveTimeout : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void fallback();
+    void expiredWindowsDoNotRatchet();
+    void persistence();
+
+};
+
+void TestAdaptiveTimeout::fallback()
+{
+    AdaptiveTimeout adaptiveTimeout;
+    for (int i = 0; i < 9; i++)
+        adaptiveTimeout.record(5000);
+
+    QCOMPARE(adaptiveTimeout.timeout(60), 60);
+
+    // The 99th percentile plus the margin
+    adaptiveTimeout.record(5000);
+    QCOMPARE(adaptiveTimeout.timeout(60), 20);
+}
+
+void TestAdaptiveTimeout::expiredWindowsDoNotRatchet()
+{
+    AdaptiveTimeout adaptiveTimeout;
+    for (int i = 0; i < 20; i++)
+        adaptiveTimeout.record(5000);
+
+    int timeout = adaptiveTimeout.timeout(60);
+
+    // Most windows expire unused, the timeout must stay close to the latencies
+    for (int i = 0; i < 100; i++)
+        adaptiveTimeout.recordExpired();
+
+    QCOMPARE(adaptiveTimeout.expiredCount(), 10);
+    QCOMPARE(adaptiveTimeout.timeout(60), timeout + 15);
+
+    // Real latencies take the extension back
+    for (int i = 0; i < 10; i++)
+        adaptiveTimeout.record(5000);
+
+    QCOMPARE(adaptiveTimeout.expiredCount(), 0);
+    QCOMPARE(adaptiveTimeout.timeout(60), timeout);
+}
+
+void TestAdaptiveTimeout::persistence()
+{
+    QTemporaryDir directory;
+    QVERIFY(directory.isValid());
+    QString fileName = directory.path() + "/connect-latency.json";
+
+    {
+        AdaptiveTimeout adaptiveTimeout;
+        adaptiveTimeout.setStateFile(fileName);
+        for (int i = 0; i < 12; i++)
+            adaptiveTimeout.record(3000);
+        adaptiveTimeout.recordExpired();
+    }
+
+    AdaptiveTimeout adaptiveTimeout;
+    adaptiveTimeout.setStateFile(fileName);
+    QCOMPARE(adaptiveTimeout.sampleCount(), 12);
+    QCOMPARE(adaptiveTimeout.expiredCount(), 1);
+}
+
+QTEST_GUILESS_MAIN(TestAdaptiveTimeout)
+
+#include "testadaptivetimeout.moc"
@@ -0,0 +1,13 @@
+include(../../nymea-networkmanager.pri)
+include(../../nymea-networkmanager/sources.pri)
+
+TARGET = testadaptivetimeout
+
+QT += testlib
+
+CONFIG += console testcase no_testcase_installs
+CONFIG -= app_bundle
+
+TEMPLATE = app
+
+SOURCES += testadaptivetimeout.cpp
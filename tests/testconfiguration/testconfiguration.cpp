@@ -0,0 +1,297 @@
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+/* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * *
+*
+* Copyright (C) 2013 - 2024, nymea GmbH
+* Copyright (C) 2024 - 2025, chargebyte austria GmbH
+*
+* This file is part of nymea-networkmanager.
+*
+* nymea-networkmanager is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 3 of the License, or
+* (at your option) any later version.
+*
+* nymea-networkmanager is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with nymea-networkmanager. If not, see <https://www.gnu.org/licenses/>.
+*
+* * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * * */
+
+#include <QtTest>
+#include <QTemporaryFile>
+#include <QCommandLineParser>
+
+#include "configuration.h"
+
+class TestConfiguration : public QObject
+{
+    Q_OBJECT
+
+private:
+    QString writeConfigurationFile(const QByteArray &content);
+
+    QList<QTemporaryFile *> m_files;
+
+private slots:
+    void cleanup();
+
+    void defaults();
+
+    void rangeRejection_data();
+    void rangeRejection();
+
+    void enumParsing_data();
+    void enumParsing();
+    void invalidModeInFile();
+
+    void boolParsing();
+
+    void unknownKeys();
+
+    void commandLineOverridePrecedence();
+    void commandLineHelp();
+
+};
+
+QString TestConfiguration::writeConfigurationFile(const QByteArray &content)
+{
+    QTemporaryFile *file = new QTemporaryFile();
+    m_files.append(file);
+    if (!file->open())
+        return QString();
+
+    file->write(content);
+    file->close();
+    return file->fileName();
+}
+
+void TestConfiguration::cleanup()
+{
+    qDeleteAll(m_files);
+    m_files.clear();
+}
+
+void TestConfiguration::defaults()
+{
+    Configuration configuration;
+    QVERIFY2(configuration.load(QString()), qPrintable(configuration.errorString()));
+    QCOMPARE(configuration.mode, Core::ModeOffline);
+    QCOMPARE(configuration.timeout, 60);
+    QCOMPARE(configuration.timeoutPolicy, Core::TimeoutPolicyFixed);
+    QCOMPARE(configuration.offlineDebounce, 1000);
+    QCOMPARE(configuration.nymeaCallTimeout, 5000);
+    QCOMPARE(configuration.maxSessions, 1);
+    QCOMPARE(configuration.idleExit, false);
+    QCOMPARE(configuration.scheduleStart.isValid(), false);
+    QCOMPARE(configuration.buttonGpio, -1);
+    QCOMPARE(configuration.advertiseName, QString("BT-WiFi"));
+    QCOMPARE(configuration.platformName, QString("nymea"));
+    QCOMPARE(configuration.stateDirectory, QString("/var/lib/nymea-networkmanager"));
+    QCOMPARE(configuration.scanMaxAge, 0);
+    QCOMPARE(configuration.networkManagerProfile, Core::NetworkManagerProfileFull);
+
+    // Removed keys fall back to the defaults when loading again
+    QVERIFY(configuration.load(writeConfigurationFile("Timeout=120\n")));
+    QCOMPARE(configuration.timeout, 120);
+    QVERIFY(configuration.load(writeConfigurationFile("MaxSessions=2\n")));
+    QCOMPARE(configuration.timeout, 60);
+    QCOMPARE(configuration.maxSessions, 2);
+}
+
+void TestConfiguration::rangeRejection_data()
+{
+    QTest::addColumn<QString>("key");
+    QTest::addColumn<QString>("value");
+    QTest::addColumn<bool>("valid");
+
+    QTest::newRow("timeout minimum") << "Timeout" << "10" << true;
+    QTest::newRow("timeout below minimum") << "Timeout" << "9" << false;
+    QTest::newRow("timeout not a number") << "Timeout" << "ten" << false;
+    QTest::newRow("sessions below minimum") << "MaxSessions" << "0" << false;
+    QTest::newRow("debounce disabled") << "OfflineDebounceMs" << "0" << true;
+    QTest::newRow("debounce negative") << "OfflineDebounceMs" << "-1" << false;
+    QTest::newRow("call timeout below minimum") << "NymeaCallTimeoutMs" << "99" << false;
+    QTest::newRow("gpio disabled") << "ButtonGpio" << "-1" << true;
+    QTest::newRow("gpio below minimum") << "ButtonGpio" << "-2" << false;
+    QTest::newRow("schedule") << "AdvertisingSchedule" << "08:00-18:00" << true;
+    QTest::newRow("schedule without end") << "AdvertisingSchedule" << "08:00" << false;
+    QTest::newRow("schedule invalid time") << "AdvertisingSchedule" << "08:00-25:00" << false;
+    QTest::newRow("bus type") << "DBusBusType" << "session" << true;
+    QTest::newRow("bus type unknown") << "DBusBusType" << "user" << false;
+    QTest::newRow("bool true") << "IdleExit" << "true" << true;
+    QTest::newRow("bool upper case") << "IdleExit" << "False" << true;
+    QTest::newRow("bool number") << "IdleExit" << "1" << true;
+    QTest::newRow("bool yes") << "IdleExit" << "yes" << true;
+    QTest::newRow("bool no") << "IdleExit" << "no" << true;
+    QTest::newRow("bool unknown") << "IdleExit" << "enabled" << false;
+    QTest::newRow("bool empty") << "ButtonActiveLow" << "" << false;
+}
+
+void TestConfiguration::rangeRejection()
+{
+    QFETCH(QString, key);
+    QFETCH(QString, value);
+    QFETCH(bool, valid);
+
+    QVariantMap overrides;
+    overrides.insert(key, value);
+
+    Configuration configuration;
+    QCOMPARE(configuration.load(QString(), overrides), valid);
+    QCOMPARE(configuration.errorString().isEmpty(), valid);
+}
+
+void TestConfiguration::enumParsing_data()
+{
+    QTest::addColumn<QString>("key");
+    QTest::addColumn<QString>("value");
+    QTest::addColumn<bool>("valid");
+
+    QTest::newRow("mode") << "Mode" << "once" << true;
+    QTest::newRow("mode upper case") << "Mode" << "ALWAYS" << true;
+    QTest::newRow("mode dbus") << "Mode" << "dbus" << true;
+    QTest::newRow("mode with prefix") << "Mode" << "ModeOnce" << false;
+    QTest::newRow("mode unknown") << "Mode" << "never" << false;
+    QTest::newRow("policy") << "TimeoutPolicy" << "adaptive" << true;
+    QTest::newRow("policy unknown") << "TimeoutPolicy" << "random" << false;
+    QTest::newRow("profile") << "NetworkManagerProfile" << "Watch" << true;
+    QTest::newRow("profile unknown") << "NetworkManagerProfile" << "minimal" << false;
+}
+
+void TestConfiguration::enumParsing()
+{
+    QFETCH(QString, key);
+    QFETCH(QString, value);
+    QFETCH(bool, valid);
+
+    QVariantMap overrides;
+    overrides.insert(key, value);
+
+    Configuration configuration;
+    QCOMPARE(configuration.load(QString(), overrides), valid);
+    if (!valid) {
+        QVERIFY(configuration.errorString().contains(value));
+        return;
+    }
+
+    if (key == "Mode") {
+        QCOMPARE(QString(QMetaEnum::fromType<Core::Mode>().valueToKey(configuration.mode)).toLower(), "mode" + value.toLower());
+    } else if (key == "TimeoutPolicy") {
+        QCOMPARE(configuration.timeoutPolicy, Core::TimeoutPolicyAdaptive);
+    } else {
+        QCOMPARE(configuration.networkManagerProfile, Core::NetworkManagerProfileWatch);
+    }
+}
+
+void TestConfiguration::invalidModeInFile()
+{
+    // A mode the file does not know is not fatal, the default mode will be used
+    Configuration configuration;
+    QVERIFY(configuration.load(writeConfigurationFile("Mode=never\nTimeout=30\n")));
+    QCOMPARE(configuration.mode, Core::ModeOffline);
+    QCOMPARE(configuration.timeout, 30);
+}
+
+void TestConfiguration::boolParsing()
+{
+    // "no" must not enable a feature
+    Configuration configuration;
+    QVERIFY(configuration.load(writeConfigurationFile("IdleExit=no\nButtonActiveLow=yes\n")));
+    QCOMPARE(configuration.idleExit, false);
+    QCOMPARE(configuration.buttonActiveLow, true);
+
+    QVariantMap overrides;
+    overrides.insert("ForceFullName", true);
+    QVERIFY(configuration.load(QString(), overrides));
+    QCOMPARE(configuration.forceFullName, true);
+
+    QVERIFY(!configuration.load(writeConfigurationFile("IdleExit=maybe\n")));
+    QVERIFY(configuration.errorString().contains("IdleExit"));
+}
+
+void TestConfiguration::unknownKeys()
+{
+    // The file may be shared with newer versions, unknown keys only warn
+    QString fileName = writeConfigurationFile("Timeout=30\nFutureKey=1\n");
+    Configuration configuration;
+    QVERIFY(configuration.load(fileName));
+    QCOMPARE(configuration.timeout, 30);
+
+    // A typo in a runtime value is an error
+    QVariantMap overrides;
+    overrides.insert("Timeuot", 30);
+    QVERIFY(!configuration.load(fileName, overrides));
+    QVERIFY(configuration.errorString().contains("Timeuot"));
+
+    QVERIFY(Configuration::findKey("Timeout"));
+    QVERIFY(!Configuration::findKey("timeout"));
+    QVERIFY(!Configuration::findKey("FutureKey"));
+}
+
+void TestConfiguration::commandLineOverridePrecedence()
+{
+    QCommandLineParser parser;
+    Configuration::addCommandLineOptions(&parser);
+    QVERIFY(parser.parse({"nymea-networkmanager", "-t", "30", "--force-name"}));
+
+    // Options with default values only count if given, switches are set to true
+    QVariantMap overrides = Configuration::commandLineOverrides(parser);
+    QCOMPARE(overrides.count(), 2);
+    QCOMPARE(overrides.value("Timeout").toString(), QString("30"));
+    QCOMPARE(overrides.value("ForceFullName").toBool(), true);
+
+    // Every option of the schema is registered, an unknown one would fail to parse
+    QStringList arguments = { "nymea-networkmanager" };
+    int optionCount = 0;
+    foreach (const Configuration::Key &key, Configuration::schema()) {
+        if (!key.option)
+            continue;
+
+        arguments << QString("--%1").arg(key.option);
+        if (!(key.flags & Configuration::FlagSwitch))
+            arguments << "1";
+
+        optionCount++;
+    }
+
+    QCommandLineParser completeParser;
+    Configuration::addCommandLineOptions(&completeParser);
+    QVERIFY2(completeParser.parse(arguments), qPrintable(completeParser.errorText()));
+    QCOMPARE(Configuration::commandLineOverrides(completeParser).count(), optionCount);
+
+    QString fileName = writeConfigurationFile("Mode=once\nTimeout=120\nForceFullName=false\nAdvertiseName=nymea-1\n");
+    Configuration configuration;
+    QVERIFY2(configuration.load(fileName, overrides), qPrintable(configuration.errorString()));
+    QCOMPARE(configuration.timeout, 30);
+    QCOMPARE(configuration.forceFullName, true);
+    QCOMPARE(configuration.mode, Core::ModeOnce);
+    QCOMPARE(configuration.advertiseName, QString("nymea-1"));
+
+    // An invalid command line value is not replaced by the file value
+    overrides.insert("Timeout", "5");
+    QVERIFY(!configuration.load(fileName, overrides));
+}
+
+void TestConfiguration::commandLineHelp()
+{
+    QCommandLineParser parser;
+    Configuration::addCommandLineOptions(&parser);
+    QString helpText = parser.helpText().simplified();
+
+    // The allowed values, the minimum and the defaults come from the schema
+    foreach (const QString &mode, QStringList() << "offline" << "once" << "button" << "always" << "start" << "dbus")
+        QVERIFY2(helpText.contains(QString("\"%1\"").arg(mode)), qPrintable(mode));
+
+    QVERIFY(helpText.contains("Minimum value is 10"));
+    QVERIFY(helpText.contains("Default \"BT-WiFi\""));
+    QVERIFY(helpText.contains("-m, --mode <MODE>"));
+}
+
+QTEST_GUILESS_MAIN(TestConfiguration)
+
+#include "testconfiguration.moc"